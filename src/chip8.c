@@ -0,0 +1,159 @@
+#include "chip8.h"
+#include "cpu.h"
+
+_Static_assert(CHIP8_MAX_ROM_SIZE == CPU_MEMORY_SIZE - CPU_PROGRAM_START, "a rom fills the memory after 0x200");
+
+/**
+ * The library handle wraps a cpu, keeping its layout out of the public header.
+ */
+struct Chip8
+{
+    Cpu cpu;
+};
+
+uint32_t chip8_api_version(void)
+{
+    return CHIP8_API_VERSION;
+}
+
+Chip8 *chip8_create(void)
+{
+    // the cpu's first line holds its registers, see Cpu.
+    Chip8 *chip8 = memory_allocate_aligned(sizeof(Chip8));
+
+    if (chip8 != NULL && !cpu_init(&chip8->cpu))
+    {
+        chip8_destroy(chip8);
+        return NULL;
+    }
+
+    return chip8;
+}
+
+void chip8_destroy(Chip8 *chip8)
+{
+    if (chip8 != NULL)
+        cpu_free(&chip8->cpu);
+
+    memory_free_aligned(chip8);
+}
+
+void chip8_reset(Chip8 *chip8)
+{
+    cpu_reset(&chip8->cpu);
+}
+
+int chip8_load_rom(Chip8 *chip8, const uint8_t *rom, uint32_t size)
+{
+    if (rom == NULL || size == 0 || size > CHIP8_MAX_ROM_SIZE)
+        return -1;
+
+    return cpu_load_rom_from_memory(&chip8->cpu, rom, size) ? 0 : -1;
+}
+
+int chip8_load_rom_file(Chip8 *chip8, const char *file_name)
+{
+    // one byte more than fits, to tell a full rom from a truncated one.
+    u8 rom[CHIP8_MAX_ROM_SIZE + 1];
+    FILE *file = fopen(file_name, "rb");
+
+    if (file == NULL)
+        return -1;
+
+    u32 size = fread(rom, 1, sizeof(rom), file);
+    fclose(file);
+
+    return chip8_load_rom(chip8, rom, size);
+}
+
+Chip8Rom *chip8_rom_create(const uint8_t *rom, uint32_t size)
+{
+    if (rom == NULL || size == 0 || size > CHIP8_MAX_ROM_SIZE)
+        return NULL;
+
+    // a rom handle is the shared memory image itself.
+    return (Chip8Rom *)cpu_create_image(rom, size);
+}
+
+void chip8_rom_destroy(Chip8Rom *rom)
+{
+    // instances still running the rom keep their own reference.
+    memory_image_release((MemoryImage *)rom);
+}
+
+void chip8_load_shared_rom(Chip8 *chip8, Chip8Rom *rom)
+{
+    cpu_load_image(&chip8->cpu, (MemoryImage *)rom);
+}
+
+uint32_t chip8_get_private_memory(const Chip8 *chip8)
+{
+    // the framebuffer and the sprite cache are allocated apart from the handle.
+    u32 size = sizeof(Chip8) + sizeof(Gpu) + memory_get_private_page_count(&chip8->cpu.memory) * sizeof(MemoryPage);
+
+    if (chip8->cpu.sprite_cache != NULL)
+        size += sizeof(SpriteCache);
+
+    return size;
+}
+
+uint32_t chip8_run(Chip8 *chip8, uint32_t cycles, Chip8StopReason *stop_reason)
+{
+    CpuStopReason reason;
+    u32 executed = cpu_run(&chip8->cpu, cycles, &reason);
+
+    if (stop_reason != NULL)
+        *stop_reason = (Chip8StopReason)reason;
+
+    return executed;
+}
+
+void chip8_tick_timers(Chip8 *chip8)
+{
+    cpu_tick_timers(&chip8->cpu);
+}
+
+void chip8_set_keys(Chip8 *chip8, uint16_t keys)
+{
+    chip8->cpu.keyboard.memory = keys;
+}
+
+void chip8_set_breakpoint(Chip8 *chip8, uint16_t address, int enabled)
+{
+    cpu_set_breakpoint(&chip8->cpu, address, enabled != 0);
+}
+
+const uint8_t *chip8_get_framebuffer(const Chip8 *chip8)
+{
+    // the framebuffer is handed out as is: one byte per pixel, 0 or 1,
+    // row major, valid until the instance is destroyed.
+    return cpu_get_gpu(&chip8->cpu)->memory;
+}
+
+uint16_t chip8_get_program_counter(const Chip8 *chip8)
+{
+    return chip8->cpu.program_counter;
+}
+
+uint8_t chip8_get_sound_timer(const Chip8 *chip8)
+{
+    return chip8->cpu.sound_timer;
+}
+
+Chip8Fault chip8_get_fault(const Chip8 *chip8)
+{
+    return (Chip8Fault)chip8->cpu.fault;
+}
+
+void chip8_get_stats(const Chip8 *chip8, Chip8Stats *stats)
+{
+    const CpuStats *cpu_stats = &chip8->cpu.stats;
+
+    stats->instructions = cpu_stats->instructions;
+    stats->fused_instructions = cpu_stats->fused_instructions;
+    stats->draws = cpu_stats->draws;
+    stats->sprite_cache_hits = cpu_stats->sprite_cache_hits;
+    stats->sprite_cache_misses = cpu_stats->draws - cpu_stats->sprite_cache_hits;
+    stats->timer_polls = cpu_stats->timer_polls;
+    stats->key_waits = cpu_stats->key_waits;
+}
@@ -0,0 +1,114 @@
+#ifndef __CHIP8_H__
+#define __CHIP8_H__
+
+/**
+ * libchip8: the emulator core without the raylib frontend.
+ *
+ * This is the stable interface of the library. Instances are opaque and
+ * only fixed width types cross it, so the internal layout of the core can
+ * change without breaking callers.
+ */
+
+#include <stdint.h>
+
+#define CHIP8_API_VERSION 1
+#define CHIP8_SCREEN_WIDTH 64
+#define CHIP8_SCREEN_HEIGHT 32
+// the memory after 0x200. Loading an empty rom or a larger one fails with
+// -1 (NULL for chip8_rom_create) and leaves the instance as it was.
+#define CHIP8_MAX_ROM_SIZE 3584
+
+typedef struct Chip8 Chip8;
+
+/**
+ * A rom loaded once and shared, read only, by every instance running it.
+ * Instances only copy the 256 byte pages they write to; a write whose
+ * copy can't be allocated halts the instance with CHIP8_FAULT_OUT_OF_MEMORY.
+ * chip8_rom_create returns NULL when the rom can't be allocated.
+ */
+typedef struct Chip8Rom Chip8Rom;
+
+/**
+ * Why chip8_run returned before running every requested cycle.
+ * Matches CpuStopReason in the core.
+ */
+typedef enum Chip8StopReason
+{
+    CHIP8_STOP_CYCLES = 0,
+    CHIP8_STOP_DRAW = 1,
+    CHIP8_STOP_SOUND = 2,
+    CHIP8_STOP_KEY_WAIT = 3,
+    CHIP8_STOP_BREAKPOINT = 4,
+    CHIP8_STOP_FAULT = 5,
+    CHIP8_STOP_TIMER_WAIT = 6
+} Chip8StopReason;
+
+/**
+ * Why an instance halted. Matches CpuFault in the core.
+ * A faulted instance runs no more cycles until it's reset or loaded.
+ */
+typedef enum Chip8Fault
+{
+    CHIP8_FAULT_NONE = 0,
+    CHIP8_FAULT_STACK_OVERFLOW = 1,
+    CHIP8_FAULT_STACK_UNDERFLOW = 2,
+    CHIP8_FAULT_OUT_OF_MEMORY = 3
+} Chip8Fault;
+
+/**
+ * Counters since the last reset or rom load.
+ * Draws are DRW instructions; a hit means the sprite rows came from the
+ * instance's sprite cache instead of being read and expanded again.
+ * Timer polls are delay timer reads (Fx07), key waits are Fx0A executions
+ * that found no key pressed.
+ */
+typedef struct Chip8Stats
+{
+    uint64_t instructions;
+    uint64_t fused_instructions;
+    uint64_t draws;
+    uint64_t sprite_cache_hits;
+    uint64_t sprite_cache_misses;
+    uint64_t timer_polls;
+    uint64_t key_waits;
+} Chip8Stats;
+
+uint32_t chip8_api_version(void);
+
+Chip8 *chip8_create(void);
+
+void chip8_destroy(Chip8 *chip8);
+
+void chip8_reset(Chip8 *chip8);
+
+int chip8_load_rom(Chip8 *chip8, const uint8_t *rom, uint32_t size);
+
+int chip8_load_rom_file(Chip8 *chip8, const char *file_name);
+
+Chip8Rom *chip8_rom_create(const uint8_t *rom, uint32_t size);
+
+void chip8_rom_destroy(Chip8Rom *rom);
+
+void chip8_load_shared_rom(Chip8 *chip8, Chip8Rom *rom);
+
+uint32_t chip8_get_private_memory(const Chip8 *chip8);
+
+uint32_t chip8_run(Chip8 *chip8, uint32_t cycles, Chip8StopReason *stop_reason);
+
+void chip8_tick_timers(Chip8 *chip8);
+
+void chip8_set_keys(Chip8 *chip8, uint16_t keys);
+
+void chip8_set_breakpoint(Chip8 *chip8, uint16_t address, int enabled);
+
+const uint8_t *chip8_get_framebuffer(const Chip8 *chip8);
+
+uint16_t chip8_get_program_counter(const Chip8 *chip8);
+
+uint8_t chip8_get_sound_timer(const Chip8 *chip8);
+
+Chip8Fault chip8_get_fault(const Chip8 *chip8);
+
+void chip8_get_stats(const Chip8 *chip8, Chip8Stats *stats);
+
+#endif /*__CHIP8_H__*/
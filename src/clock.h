@@ -0,0 +1,28 @@
+#ifndef __CLOCK_H__
+#define __CLOCK_H__
+
+#include <time.h>
+#include "types.h"
+
+/**
+ * The host's monotonic clock, for everything that measures host time: the
+ * governor, the profiler and the tools. It never jumps with the wall
+ * clock, so only the difference between two readings means anything.
+ */
+static inline u64 clock_get_nanoseconds()
+{
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (u64)time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+static inline f64 clock_get_seconds()
+{
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+#endif /*__CLOCK_H__*/
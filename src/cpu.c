@@ -1,6 +1,25 @@
 #include "cpu.h"
 
-#define PROGRAM_START 0x200
+#define PROGRAM_START CPU_PROGRAM_START
+
+/**
+ * Macro-op kinds stored in the memory page tags.
+ * Each kind covers the instruction at the tagged address and the one after it.
+ * Pairs never cross a page, so a write only invalidates tags of its own page.
+ */
+#define FUSED_NONE 0
+#define FUSED_SKIP_JP 1
+#define FUSED_LD_ADD 2
+#define FUSED_LD_I_DRW 3
+#define FUSED_TIMER_POLL 4
+
+// salts keeping memory bytes and pixels apart in the state hash.
+#define HASH_MEMORY_SALT 0x100000000ull
+#define HASH_PIXEL_SALT 0x200000000ull
+
+#define FONT_IMAGE_MISSING 0
+#define FONT_IMAGE_BUILDING 1
+#define FONT_IMAGE_READY 2
 
 /**
  * The default font sprites.
@@ -26,10 +45,27 @@ const u8 FONT_SET[80] = {
 
 static inline u16 get_op(const Cpu *cpu, u16 instruction_pointer);
 static inline void execute_instruction_and_move_forward(Cpu *cpu);
+static inline u8 execute_fused_op(Cpu *cpu, u8 fused_op);
+static inline bool write_memory(Cpu *cpu, u16 address, u8 value);
+static inline void reset_registers(Cpu *cpu);
+static void rehash_state(Cpu *cpu);
+static inline void hash_sprite(Cpu *cpu, u8 x, u8 y, const u64 *rows, u8 length);
+static inline u64 mix_hash(u64 value);
+static inline u8 next_random(Cpu *cpu);
+static inline bool is_skip_op(u16 op_code);
+static inline bool evaluate_skip_op(const Cpu *cpu, u16 op_code);
+static inline CpuStopReason get_stop_reason(const Cpu *cpu, u16 op_code, u16 program_counter, u8 sound_timer);
+static u8 classify_fused_pair(u16 op_code, u16 next_op_code);
+static void mark_reachable_code(const u8 *memory, bool *reachable);
+static void fuse_code(const u8 *memory, u8 *tags);
+static void fill_image(MemoryImage *image, const u8 *rom, u32 size);
+static void create_font_image();
 static inline bool overflow_add(u8 *result, u8 a, u8 b);
 static inline void move_program_counter_forward(Cpu *cpu);
 static inline void move_program_counter_backward(Cpu *cpu);
+static inline void move_program_counter_by(Cpu *cpu, u16 bytes);
 static inline void move_program_counter(Cpu *cpu, u16 offset);
+static inline void raise_fault(Cpu *cpu, CpuFault fault);
 static inline void op_sys_nnn(Cpu *cpu, u16 nnn);
 static inline void op_cls(Cpu *cpu);
 static inline void op_ret(Cpu *cpu);
@@ -66,49 +102,65 @@ static inline void op_shl_vx(Cpu *cpu, u8 x);
 static inline void op_rnd_vx_kk(Cpu *cpu, u8 x, u8 kk);
 static inline void op_drw_vx_vy_n(Cpu *cpu, u8 x, u8 y, u8 n);
 
-void cpu_reset(Cpu *cpu)
+// the image every reset loads, built by the first cpu_init and shared by
+// every instance. It keeps a reference of its own, so it's never freed.
+static MemoryImage font_image __attribute__((aligned(MEMORY_CACHE_LINE_SIZE)));
+static u32 font_image_state = FONT_IMAGE_MISSING;
+
+bool cpu_init(Cpu *cpu)
 {
-    // initializes the memory.
-    memset(cpu->memory, 0, sizeof(cpu->memory));
-    memset(cpu->stack, 0, sizeof(cpu->stack));
-    memset(cpu->value_registers, 0, sizeof(cpu->value_registers));
+    memset(cpu, 0, sizeof(Cpu));
+    cpu->gpu = memory_allocate_aligned(sizeof(Gpu));
 
-    // sets the font sprites
-    memcpy(&cpu->memory, FONT_SET, sizeof(FONT_SET));
+    // cpu_free still works on the half initialized cpu.
+    if (cpu->gpu == NULL)
+        return false;
 
-    cpu->program_counter = PROGRAM_START;
-    cpu->stack_pointer = 0;
-    cpu->delay_timer = 0;
-    cpu->sound_timer = 0;
-    cpu->index_register = 0;
+    create_font_image();
+    cpu_reset(cpu);
+    return true;
+}
 
-    gpu_reset(&cpu->gpu);
-    keyboard_reset(&cpu->keyboard);
+void cpu_free(Cpu *cpu)
+{
+    memory_detach(&cpu->memory);
+    free(cpu->breakpoints);
+    cpu->breakpoints = NULL;
+    sprite_cache_free(cpu->sprite_cache);
+    cpu->sprite_cache = NULL;
+    memory_free_aligned(cpu->gpu);
+    cpu->gpu = NULL;
 }
 
-void cpu_load_rom(Cpu *cpu, const char *file_name)
+void cpu_reset(Cpu *cpu)
 {
-    cpu_reset(cpu);
+    cpu_load_image(cpu, &font_image);
+}
 
-    // moves rom from file to ram
+void cpu_load_rom(Cpu *cpu, const char *file_name)
+{
+    u8 rom[CPU_MEMORY_SIZE - PROGRAM_START];
     FILE *file = fopen(file_name, "rb");
-    u16 i = PROGRAM_START;
 
     if (file == NULL)
     {
         perror("Unable to load the rom");
+        cpu_reset(cpu);
         return;
     }
 
-    while (!feof(file))
+    // reads the whole rom to a buffer in a single call.
+    u32 size = fread(rom, 1, sizeof(rom), file);
+    fclose(file);
+
+    if (!cpu_load_rom_from_memory(cpu, rom, size))
     {
-        cpu->memory[i++] = fgetc(file);
+        fprintf(stderr, "Unable to allocate the rom image\n");
+        return;
     }
 
-    fclose(file);
-
     char instruction[100];
-    i = PROGRAM_START;
+    u16 i = PROGRAM_START;
     file = fopen("disassemble.txt", "wt");
 
     if (file == NULL)
@@ -118,7 +170,7 @@ void cpu_load_rom(Cpu *cpu, const char *file_name)
     }
 
     // disassemble the op_code
-    while (i < sizeof(cpu->memory) / 2)
+    while (i < CPU_MEMORY_SIZE / 2)
     {
         memset(instruction, 0, sizeof(instruction));
         u16 op_code = get_op(cpu, i);
@@ -135,6 +187,106 @@ void cpu_load_rom(Cpu *cpu, const char *file_name)
     fclose(file);
 }
 
+bool cpu_load_rom_from_memory(Cpu *cpu, const u8 *rom, u32 size)
+{
+    MemoryImage *image = cpu_create_image(rom, size);
+
+    // the cpu is still left in a defined state, with only the font.
+    if (image == NULL)
+    {
+        cpu_reset(cpu);
+        return false;
+    }
+
+    cpu_load_image(cpu, image);
+    memory_image_release(image);
+
+    return true;
+}
+
+MemoryImage *cpu_create_image(const u8 *rom, u32 size)
+{
+    MemoryImage *image = memory_image_create();
+
+    if (image != NULL)
+        fill_image(image, rom, size);
+
+    return image;
+}
+
+static void fill_image(MemoryImage *image, const u8 *rom, u32 size)
+{
+    u8 memory[CPU_MEMORY_SIZE] = {0};
+    u8 tags[CPU_MEMORY_SIZE];
+
+    if (size > CPU_MEMORY_SIZE - PROGRAM_START)
+        size = CPU_MEMORY_SIZE - PROGRAM_START;
+
+    // sets the font sprites and the rom, then tags the fused macro-ops.
+    memcpy(memory, FONT_SET, sizeof(FONT_SET));
+
+    if (rom != NULL)
+        memcpy(&memory[PROGRAM_START], rom, size);
+
+    fuse_code(memory, tags);
+
+    for (u8 i = 0; i < MEMORY_PAGE_COUNT; i++)
+    {
+        memcpy(image->pages[i].data, &memory[i * MEMORY_PAGE_SIZE], MEMORY_PAGE_SIZE);
+        memcpy(image->pages[i].tags, &tags[i * MEMORY_PAGE_SIZE], MEMORY_PAGE_SIZE);
+    }
+}
+
+static void create_font_image()
+{
+    u32 state = FONT_IMAGE_MISSING;
+
+    // a cpu can be created on any thread, the first one builds the image
+    // and the others wait for it. It only takes a few microseconds.
+    if (__atomic_compare_exchange_n(&font_image_state, &state, FONT_IMAGE_BUILDING, false, __ATOMIC_ACQUIRE,
+                                    __ATOMIC_ACQUIRE))
+    {
+        font_image.references = 1;
+        fill_image(&font_image, NULL, 0);
+        __atomic_store_n(&font_image_state, FONT_IMAGE_READY, __ATOMIC_RELEASE);
+        return;
+    }
+
+    while (__atomic_load_n(&font_image_state, __ATOMIC_ACQUIRE) != FONT_IMAGE_READY)
+        ;
+}
+
+void cpu_load_image(Cpu *cpu, MemoryImage *image)
+{
+    reset_registers(cpu);
+    memory_attach(&cpu->memory, image);
+
+    if (cpu->sprite_cache != NULL)
+        sprite_cache_clear(cpu->sprite_cache);
+
+    if (cpu->hash.enabled)
+        rehash_state(cpu);
+}
+
+u8 cpu_read_memory(const Cpu *cpu, u16 address)
+{
+    return memory_read(&cpu->memory, address);
+}
+
+void cpu_write_framebuffer(Cpu *cpu, const u8 *frame)
+{
+    gpu_unpack_frame(cpu->gpu, frame);
+
+    // every pixel may have changed, there's nothing to fold in.
+    if (cpu->hash.enabled)
+        rehash_state(cpu);
+}
+
+bool cpu_write_memory(Cpu *cpu, u16 address, u8 value)
+{
+    return write_memory(cpu, address, value);
+}
+
 void cpu_execute_op(Cpu *cpu, const u16 op_code)
 {
     u8 op1 = ((op_code & 0xF000) >> 12);
@@ -252,8 +404,16 @@ void cpu_execute_op(Cpu *cpu, const u16 op_code)
 
 void cpu_clock(Cpu *cpu)
 {
+    if (cpu->fault != CPU_FAULT_NONE)
+        return;
+
     execute_instruction_and_move_forward(cpu);
+}
 
+void cpu_tick_timers(Cpu *cpu)
+{
+    // the delay and sound timers count down at 60hz, independently of
+    // how many instructions run in between.
     if (cpu->delay_timer > 0)
     {
         cpu->delay_timer--;
@@ -265,6 +425,191 @@ void cpu_clock(Cpu *cpu)
     }
 }
 
+u32 cpu_run(Cpu *cpu, u32 cycles, CpuStopReason *stop_reason)
+{
+    // the batch counters stay in locals for the whole batch, and are only
+    // written back once it finishes. The program counter and I stay in the
+    // cpu: every handler reads and writes them there, and they share the
+    // first cache line with the registers the handlers touch anyway.
+    const Memory *memory = &cpu->memory;
+    const bool stops = stop_reason != NULL;
+    const bool breakpoints = stops && cpu->breakpoints != NULL;
+    CpuStopReason reason = CPU_STOP_CYCLES;
+    u32 executed = 0;
+    u32 fused = 0;
+
+    // a faulted cpu stays halted, it's only checked once per batch.
+    if (cpu->fault != CPU_FAULT_NONE)
+    {
+        if (stops)
+            *stop_reason = CPU_STOP_FAULT;
+
+        return 0;
+    }
+
+    while (executed < cycles)
+    {
+        u16 program_counter = cpu->program_counter;
+        u8 fused_op = memory_read_tag(memory, program_counter);
+
+        // the instruction a batch starts on always runs, otherwise
+        // execution could never continue past a breakpoint.
+        if (breakpoints && executed > 0 && cpu_has_breakpoint(cpu, program_counter))
+        {
+            reason = CPU_STOP_BREAKPOINT;
+            break;
+        }
+
+        // a fused pair always counts as two cycles, so it only runs when
+        // both instructions fit in the batch and there's no breakpoint on
+        // the second one. This keeps the program counter on an instruction
+        // boundary whenever the batch returns.
+        if (fused_op != FUSED_NONE && executed + 2 <= cycles &&
+            !(breakpoints && cpu_has_breakpoint(cpu, program_counter + 2)))
+        {
+            u8 count = execute_fused_op(cpu, fused_op);
+            executed += count;
+            fused += count;
+
+            if (stops && fused_op == FUSED_LD_I_DRW)
+            {
+                reason = CPU_STOP_DRAW;
+                break;
+            }
+
+            if (stops && fused_op == FUSED_TIMER_POLL && cpu->delay_timer != 0 && cpu_is_waiting_on_timer(cpu))
+            {
+                reason = CPU_STOP_TIMER_WAIT;
+                break;
+            }
+
+            continue;
+        }
+
+        u16 op_code = get_op(cpu, program_counter);
+        u8 sound_timer = cpu->sound_timer;
+
+        cpu_execute_op(cpu, op_code);
+        move_program_counter_forward(cpu);
+        executed++;
+
+        if (stops)
+        {
+            reason = get_stop_reason(cpu, op_code, program_counter, sound_timer);
+
+            if (reason != CPU_STOP_CYCLES)
+                break;
+        }
+        // a faulted instruction would run again for the rest of the batch.
+        // Fused pairs never fault, so only this path checks.
+        else if (cpu->fault != CPU_FAULT_NONE)
+        {
+            break;
+        }
+    }
+
+    cpu->stats.instructions += executed;
+    cpu->stats.fused_instructions += fused;
+
+    if (stops)
+        *stop_reason = reason;
+
+    return executed;
+}
+
+void cpu_set_breakpoint(Cpu *cpu, u16 address, bool enabled)
+{
+    address &= CPU_MEMORY_SIZE - 1;
+
+    // the bitmap is only allocated once a breakpoint is set, the runner
+    // skips every check while it doesn't exist.
+    if (cpu->breakpoints == NULL)
+    {
+        if (!enabled)
+            return;
+
+        cpu->breakpoints = calloc(CPU_MEMORY_SIZE / 8, 1);
+    }
+
+    if (enabled)
+        cpu->breakpoints[address >> 3] |= (1 << (address & 0x07));
+    else
+        cpu->breakpoints[address >> 3] &= ~(1 << (address & 0x07));
+}
+
+bool cpu_has_breakpoint(const Cpu *cpu, u16 address)
+{
+    address &= CPU_MEMORY_SIZE - 1;
+
+    return cpu->breakpoints != NULL &&
+           (cpu->breakpoints[address >> 3] & (1 << (address & 0x07))) != 0;
+}
+
+f32 cpu_get_fused_hit_rate(const Cpu *cpu)
+{
+    if (cpu->stats.instructions == 0)
+        return 0;
+
+    return (f32)cpu->stats.fused_instructions / (f32)cpu->stats.instructions;
+}
+
+f32 cpu_get_sprite_cache_hit_rate(const Cpu *cpu)
+{
+    if (cpu->stats.draws == 0)
+        return 0;
+
+    return (f32)cpu->stats.sprite_cache_hits / (f32)cpu->stats.draws;
+}
+
+void cpu_save_state(const Cpu *cpu, CpuState *state)
+{
+    memcpy(state->registers, cpu, sizeof(state->registers));
+    state->hash = cpu->hash;
+    state->gpu = *cpu->gpu;
+    state->private_pages = cpu->memory.private_pages;
+
+    for (u8 i = 0; i < MEMORY_PAGE_COUNT; i++)
+    {
+        if (state->private_pages & (1 << i))
+            memcpy(&state->pages[i], cpu->memory.pages[i], sizeof(MemoryPage));
+    }
+}
+
+void cpu_load_state(Cpu *cpu, const CpuState *state)
+{
+    memcpy(cpu, state->registers, sizeof(state->registers));
+    cpu->hash = state->hash;
+    *cpu->gpu = state->gpu;
+
+    // shared pages hold the same bytes on both sides, only sprites read
+    // from private pages may be stale.
+    if (cpu->sprite_cache != NULL)
+        sprite_cache_invalidate_pages(cpu->sprite_cache, cpu->memory.private_pages | state->private_pages);
+
+    // pages that were still shared go back to the image, the private ones
+    // get their data and their fused macro-op tags back.
+    for (u8 i = 0; i < MEMORY_PAGE_COUNT; i++)
+    {
+        if ((state->private_pages & (1 << i)) == 0)
+        {
+            memory_share_page(&cpu->memory, i);
+            continue;
+        }
+
+        MemoryPage *page = memory_get_writable_page(&cpu->memory, i << MEMORY_PAGE_SHIFT);
+
+        // the page keeps the image's bytes, so the cpu is halted rather
+        // than left running a state that was never saved.
+        if (page == NULL)
+        {
+            cpu->fault = CPU_FAULT_OUT_OF_MEMORY;
+            continue;
+        }
+
+        memcpy(page, &state->pages[i], sizeof(MemoryPage));
+    }
+}
+
 void cpu_disassemble_op(const Cpu *cpu, const u16 op_code, char *instruction)
 {
     u8 op1 = ((op_code & 0xF000) >> 12);
@@ -387,7 +732,7 @@ u32 cpu_disassemble_code(const Cpu *cpu, char ***instructions)
 {
     u32 i = 0;
     u32 j = 0;
-    u32 size = sizeof(cpu->memory);
+    u32 size = CPU_MEMORY_SIZE;
     u32 instruction_count = (size - PROGRAM_START) / 2;
     u32 instruction_size = instruction_count * sizeof(char *);
     char buffer[100];
@@ -436,10 +781,71 @@ u16 cpu_get_instruction_pointer_index(const Cpu *cpu)
     return (cpu->program_counter - PROGRAM_START) / 2;
 }
 
+void cpu_find_reachable_code(const u8 *memory, bool *reachable)
+{
+    // memory is a flat copy of the whole address space, rom at 0x200.
+    mark_reachable_code(memory, reachable);
+}
+
+bool cpu_is_waiting_on_timer(const Cpu *cpu)
+{
+    if (cpu->delay_timer == 0)
+        return false;
+
+    // the usual wait, Fx07, 3x00 and a jump back to Fx07, with the program
+    // counter anywhere inside it.
+    for (u8 i = 0; i < 3; i++)
+    {
+        u16 address = (cpu->program_counter - i * 2) & (CPU_MEMORY_SIZE - 1);
+        u16 op_code = get_op(cpu, address);
+
+        if ((op_code & 0xF0FF) == 0xF007 &&
+            get_op(cpu, address + 2) == (0x3000 | (op_code & 0x0F00)) &&
+            get_op(cpu, address + 4) == (0x1000 | address))
+            return true;
+    }
+
+    return false;
+}
+
+void cpu_enable_state_hash(Cpu *cpu, bool enabled)
+{
+    // the only full pass, from then on every write keeps it up to date.
+    cpu->hash.enabled = enabled;
+
+    if (enabled)
+        rehash_state(cpu);
+}
+
+const Gpu *cpu_get_gpu(const Cpu *cpu)
+{
+    return cpu->gpu;
+}
+
+u64 cpu_get_state_hash(const Cpu *cpu)
+{
+    u64 values[2];
+    u64 hash = cpu->hash.memory ^ cpu->hash.framebuffer;
+
+    memcpy(values, cpu->value_registers, sizeof(values));
+    hash = mix_hash(hash ^ values[0]);
+    hash = mix_hash(hash ^ values[1]);
+    hash = mix_hash(hash ^ ((u64)cpu->index_register | (u64)cpu->program_counter << 16 |
+                            (u64)cpu->stack_pointer << 32 | (u64)cpu->delay_timer << 40 |
+                            (u64)cpu->sound_timer << 48 | (u64)cpu->fault << 56));
+    hash = mix_hash(hash ^ cpu->random_state);
+
+    // entries past the stack pointer are stale, they don't matter.
+    for (u8 i = 0; i < cpu->stack_pointer && i < CPU_STACK_SIZE; i++)
+        hash = mix_hash(hash ^ ((u64)i << 16 | cpu->stack[i]));
+
+    return hash;
+}
+
 static inline u16 get_op(const Cpu *cpu, u16 instruction_pointer)
 {
-    return (cpu->memory[instruction_pointer] << 8) |
-           cpu->memory[instruction_pointer + 1];
+    return (memory_read(&cpu->memory, instruction_pointer) << 8) |
+           memory_read(&cpu->memory, instruction_pointer + 1);
 }
 
 static inline void execute_instruction_and_move_forward(Cpu *cpu)
@@ -449,6 +855,308 @@ static inline void execute_instruction_and_move_forward(Cpu *cpu)
     move_program_counter_forward(cpu);
 }
 
+static inline u8 execute_fused_op(Cpu *cpu, u8 fused_op)
+{
+    // the handlers below execute both instructions of the pair without going
+    // through the decoder, but keep the exact per instruction side effects.
+    u16 op_code = get_op(cpu, cpu->program_counter);
+    u16 next_op_code = get_op(cpu, cpu->program_counter + 2);
+
+    switch (fused_op)
+    {
+    case FUSED_SKIP_JP:
+        // the skip was taken, so the jump never executes.
+        if (evaluate_skip_op(cpu, op_code))
+        {
+            move_program_counter_by(cpu, 4);
+            return 1;
+        }
+
+        cpu->program_counter = next_op_code & 0x0FFF;
+        return 2;
+
+    case FUSED_LD_ADD:
+        op_ld_vx_kk(cpu, (op_code & 0x0F00) >> 8, op_code & 0x00FF);
+        op_add_vx_kk(cpu, (next_op_code & 0x0F00) >> 8, next_op_code & 0x00FF);
+        move_program_counter_by(cpu, 4);
+        return 2;
+
+    case FUSED_LD_I_DRW:
+        op_ld_i_nnn(cpu, op_code & 0x0FFF);
+        op_drw_vx_vy_n(cpu, (next_op_code & 0x0F00) >> 8, (next_op_code & 0x00F0) >> 4, next_op_code & 0x000F);
+        move_program_counter_by(cpu, 4);
+        return 2;
+
+    case FUSED_TIMER_POLL:
+    {
+        u8 x = (op_code & 0x0F00) >> 8;
+        op_ld_vx_dt(cpu, x);
+        move_program_counter_by(cpu, cpu->value_registers[x] == 0 ? 6 : 4);
+        return 2;
+    }
+    }
+
+    return 0;
+}
+
+static inline bool write_memory(Cpu *cpu, u16 address, u8 value)
+{
+    MemoryPage *page = memory_get_writable_page(&cpu->memory, address);
+    u16 offset = address & (MEMORY_PAGE_SIZE - 1);
+
+    // the page is still shared and couldn't be copied.
+    if (page == NULL)
+        return false;
+
+    if (cpu->hash.enabled)
+    {
+        u64 key = HASH_MEMORY_SALT | (u64)(address & (CPU_MEMORY_SIZE - 1)) << 8;
+        cpu->hash.memory ^= mix_hash(key | page->data[offset]) ^ mix_hash(key | value);
+    }
+
+    page->data[offset] = value;
+
+    // a pair starting up to 3 bytes before the written address covers it,
+    // and pairs never cross pages.
+    for (u16 i = offset < 3 ? 0 : offset - 3; i <= offset; i++)
+        page->tags[i] = FUSED_NONE;
+
+    if (cpu->sprite_cache != NULL)
+        sprite_cache_invalidate(cpu->sprite_cache, address);
+
+    return true;
+}
+
+static inline void reset_registers(Cpu *cpu)
+{
+    memset(cpu->stack, 0, sizeof(cpu->stack));
+    memset(cpu->value_registers, 0, sizeof(cpu->value_registers));
+    memset(&cpu->stats, 0, sizeof(cpu->stats));
+
+    cpu->program_counter = PROGRAM_START;
+    cpu->stack_pointer = 0;
+    cpu->delay_timer = 0;
+    cpu->sound_timer = 0;
+    cpu->index_register = 0;
+    cpu->fault = CPU_FAULT_NONE;
+    cpu->random_state = CPU_RANDOM_SEED;
+
+    gpu_reset(cpu->gpu);
+    keyboard_reset(&cpu->keyboard);
+    cpu->hash.framebuffer = 0;
+}
+
+static void rehash_state(Cpu *cpu)
+{
+    cpu->hash.memory = 0;
+    cpu->hash.framebuffer = 0;
+
+    // every byte counts, zeros included, so a write is always a swap of
+    // two terms. Unlit pixels add nothing.
+    for (u32 i = 0; i < CPU_MEMORY_SIZE; i++)
+        cpu->hash.memory ^= mix_hash(HASH_MEMORY_SALT | (u64)i << 8 | memory_read(&cpu->memory, i));
+
+    for (u32 i = 0; i < GPU_SCREEN_WIDTH * GPU_SCREEN_HEIGHT; i++)
+    {
+        if (cpu->gpu->memory[i])
+            cpu->hash.framebuffer ^= mix_hash(HASH_PIXEL_SALT | i);
+    }
+}
+
+static inline void hash_sprite(Cpu *cpu, u8 x, u8 y, const u64 *rows, u8 length)
+{
+    // a draw flips exactly the pixels set in the sprite.
+    for (u8 row = 0; row < length; row++)
+    {
+        u8 pixels[GPU_SPRITE_WIDTH];
+        u32 line = ((y + row) % GPU_SCREEN_HEIGHT) * GPU_SCREEN_WIDTH;
+
+        memcpy(pixels, &rows[row], sizeof(pixels));
+
+        for (u8 bit = 0; bit < GPU_SPRITE_WIDTH; bit++)
+        {
+            if (pixels[bit])
+                cpu->hash.framebuffer ^= mix_hash(HASH_PIXEL_SALT | (line + (x + bit) % GPU_SCREEN_WIDTH));
+        }
+    }
+}
+
+static inline u64 mix_hash(u64 value)
+{
+    // the splitmix64 finalizer.
+    value += 0x9E3779B97F4A7C15ull;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+    return value ^ (value >> 31);
+}
+
+static inline u8 next_random(Cpu *cpu)
+{
+    // xorshift32, kept in the cpu so snapshots and replays draw the same
+    // numbers.
+    u32 state = cpu->random_state;
+
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    cpu->random_state = state;
+
+    return state >> 24;
+}
+
+static inline bool is_skip_op(u16 op_code)
+{
+    u8 op1 = (op_code & 0xF000) >> 12;
+    u8 op4 = op_code & 0x000F;
+    u8 kk = op_code & 0x00FF;
+
+    return op1 == 0x03 || op1 == 0x04 ||
+           ((op1 == 0x05 || op1 == 0x09) && op4 == 0x00) ||
+           (op1 == 0x0E && (kk == 0x9E || kk == 0xA1));
+}
+
+static inline CpuStopReason get_stop_reason(const Cpu *cpu, u16 op_code, u16 program_counter, u8 sound_timer)
+{
+    switch (op_code & 0xF000)
+    {
+    case 0x0000:
+        if (op_code == 0x00EE && cpu->fault != CPU_FAULT_NONE)
+            return CPU_STOP_FAULT;
+
+        return op_code == 0x00E0 ? CPU_STOP_DRAW : CPU_STOP_CYCLES;
+
+    case 0x2000:
+        return cpu->fault != CPU_FAULT_NONE ? CPU_STOP_FAULT : CPU_STOP_CYCLES;
+
+    case 0xD000:
+        return CPU_STOP_DRAW;
+
+    case 0xF000:
+        // Fx0A rewinds the program counter while no key is pressed.
+        // Fx33 and Fx55 fault when a page can't be copied.
+        if (cpu->fault != CPU_FAULT_NONE)
+            return CPU_STOP_FAULT;
+
+        if ((op_code & 0x00FF) == 0x0A && cpu->program_counter == program_counter)
+            return CPU_STOP_KEY_WAIT;
+
+        if ((op_code & 0x00FF) == 0x18 && sound_timer == 0 && cpu->sound_timer > 0)
+            return CPU_STOP_SOUND;
+
+        if ((op_code & 0x00FF) == 0x07 && cpu->delay_timer != 0 && cpu_is_waiting_on_timer(cpu))
+            return CPU_STOP_TIMER_WAIT;
+    }
+
+    return CPU_STOP_CYCLES;
+}
+
+static inline bool evaluate_skip_op(const Cpu *cpu, u16 op_code)
+{
+    u8 vx = cpu->value_registers[(op_code & 0x0F00) >> 8];
+    u8 vy = cpu->value_registers[(op_code & 0x00F0) >> 4];
+    u8 kk = op_code & 0x00FF;
+
+    switch ((op_code & 0xF000) >> 12)
+    {
+    case 0x03:
+        return vx == kk;
+    case 0x04:
+        return vx != kk;
+    case 0x05:
+        return vx == vy;
+    case 0x09:
+        return vx != vy;
+    default:
+        // Ex9E skips when the key is pressed, ExA1 when it's not.
+        return keyboard_is_key_pressed(&cpu->keyboard, vx) == (kk == 0x9E);
+    }
+}
+
+static u8 classify_fused_pair(u16 op_code, u16 next_op_code)
+{
+    u8 op1 = (op_code & 0xF000) >> 12;
+    u8 next_op1 = (next_op_code & 0xF000) >> 12;
+
+    if (is_skip_op(op_code) && next_op1 == 0x01)
+        return FUSED_SKIP_JP;
+
+    if (op1 == 0x06 && next_op1 == 0x07)
+        return FUSED_LD_ADD;
+
+    if (op1 == 0x0A && next_op1 == 0x0D)
+        return FUSED_LD_I_DRW;
+
+    // Fx07 followed by 3x00: the usual delay timer poll.
+    if ((op_code & 0xF0FF) == 0xF007 && (next_op_code & 0xF0FF) == 0x3000 &&
+        (op_code & 0x0F00) == (next_op_code & 0x0F00))
+        return FUSED_TIMER_POLL;
+
+    return FUSED_NONE;
+}
+
+static void fuse_code(const u8 *memory, u8 *tags)
+{
+    bool reachable[CPU_MEMORY_SIZE];
+
+    memset(tags, FUSED_NONE, CPU_MEMORY_SIZE);
+    mark_reachable_code(memory, reachable);
+
+    for (u16 i = PROGRAM_START; i + 3 < CPU_MEMORY_SIZE; i++)
+    {
+        // both instructions must be reachable, the second one as the
+        // fall through of the first, and the pair must fit in a page.
+        if (!reachable[i] || !reachable[i + 2] || (i & (MEMORY_PAGE_SIZE - 1)) > MEMORY_PAGE_SIZE - 4)
+            continue;
+
+        tags[i] = classify_fused_pair((memory[i] << 8) | memory[i + 1], (memory[i + 2] << 8) | memory[i + 3]);
+    }
+}
+
+static void mark_reachable_code(const u8 *memory, bool *reachable)
+{
+    u16 pending[CPU_MEMORY_SIZE + 1];
+    u32 pending_count = 0;
+
+    memset(reachable, false, CPU_MEMORY_SIZE * sizeof(bool));
+    pending[pending_count++] = PROGRAM_START;
+
+    // walks every path from the program start, following jumps, calls and
+    // both sides of the skips. Computed jumps (Bnnn) and returns end a path.
+    while (pending_count > 0)
+    {
+        u16 i = pending[--pending_count];
+
+        while (i + 1 < CPU_MEMORY_SIZE && !reachable[i])
+        {
+            u16 op_code = (memory[i] << 8) | memory[i + 1];
+            u8 op1 = (op_code & 0xF000) >> 12;
+            u16 nnn = op_code & 0x0FFF;
+
+            reachable[i] = true;
+
+            if (op_code == 0x00EE || op1 == 0x0B)
+                break;
+
+            if (op1 == 0x01)
+            {
+                pending[pending_count++] = nnn;
+                break;
+            }
+
+            if (op1 == 0x00 && op_code != 0x00E0)
+            {
+                pending[pending_count++] = nnn + 2;
+                break;
+            }
+
+            if (op1 == 0x02 || is_skip_op(op_code))
+                pending[pending_count++] = op1 == 0x02 ? nnn : i + 4;
+
+            i += 2;
+        }
+    }
+}
+
 static inline bool overflow_add(u8 *result, u8 a, u8 b)
 {
     *result = a + b;
@@ -466,19 +1174,26 @@ static inline void move_program_counter_forward(Cpu *cpu)
 {
     // we move two bytes ahead: each instruction is 2 bytes,
     // so we are moving one instruction ahead.
-    cpu->program_counter += 2;
+    move_program_counter_by(cpu, 2);
 }
 
 static inline void move_program_counter_backward(Cpu *cpu)
 {
-    // we move two bytes ahead: each instruction is 2 bytes,
-    // so we are moving one instruction ahead.
-    cpu->program_counter -= 2;
+    // we move two bytes back: each instruction is 2 bytes,
+    // so we are moving one instruction back.
+    move_program_counter_by(cpu, -2);
+}
+
+static inline void move_program_counter_by(Cpu *cpu, u16 bytes)
+{
+    // the program counter wraps around the address space, so it always
+    // points inside memory without a bounds check.
+    cpu->program_counter = (cpu->program_counter + bytes) & (CPU_MEMORY_SIZE - 1);
 }
 
 static inline void move_program_counter(Cpu *cpu, u16 offset)
 {
-    cpu->program_counter = offset - 2;
+    cpu->program_counter = (offset - 2) & (CPU_MEMORY_SIZE - 1);
 }
 
 static inline void op_sys_nnn(Cpu *cpu, u16 nnn)
@@ -486,15 +1201,30 @@ static inline void op_sys_nnn(Cpu *cpu, u16 nnn)
     cpu->program_counter = nnn;
 }
 
+static inline void raise_fault(Cpu *cpu, CpuFault fault)
+{
+    // leaves the program counter on the faulting instruction once the
+    // caller moves it forward.
+    cpu->fault = fault;
+    move_program_counter_backward(cpu);
+}
+
 static inline void op_cls(Cpu *cpu)
 {
-    gpu_reset(&cpu->gpu);
+    gpu_reset(cpu->gpu);
+    cpu->hash.framebuffer = 0;
 }
 
 static inline void op_ret(Cpu *cpu)
 {
+    if (cpu->stack_pointer == 0)
+    {
+        raise_fault(cpu, CPU_FAULT_STACK_UNDERFLOW);
+        return;
+    }
+
     cpu->stack_pointer -= 1;
-    cpu->program_counter = cpu->stack[cpu->stack_pointer];
+    cpu->program_counter = cpu->stack[cpu->stack_pointer & (CPU_STACK_SIZE - 1)];
 }
 
 static inline void op_jp_nnn(Cpu *cpu, u16 nnn)
@@ -509,6 +1239,12 @@ static inline void op_jp_v0_nnn(Cpu *cpu, u16 nnn)
 
 static inline void op_call_nnn(Cpu *cpu, u16 nnn)
 {
+    if (cpu->stack_pointer >= CPU_STACK_SIZE)
+    {
+        raise_fault(cpu, CPU_FAULT_STACK_OVERFLOW);
+        return;
+    }
+
     cpu->stack[cpu->stack_pointer] = cpu->program_counter;
     cpu->stack_pointer += 1;
     move_program_counter(cpu, nnn);
@@ -580,6 +1316,7 @@ static inline void op_ld_vx_vy(Cpu *cpu, u8 x, u8 y)
 static inline void op_ld_vx_dt(Cpu *cpu, u8 x)
 {
     cpu->value_registers[x] = cpu->delay_timer;
+    cpu->stats.timer_polls++;
 }
 
 static inline void op_ld_dt_vx(Cpu *cpu, u8 x)
@@ -605,19 +1342,25 @@ static inline void op_ld_b_vx(Cpu *cpu, u8 x)
     u8 b = x / 10;
     x = x - b * 10;
 
-    cpu->memory[i + 0] = a;
-    cpu->memory[i + 1] = b;
-    cpu->memory[i + 2] = x;
+    if (!write_memory(cpu, i + 0, a) || !write_memory(cpu, i + 1, b) || !write_memory(cpu, i + 2, x))
+        raise_fault(cpu, CPU_FAULT_OUT_OF_MEMORY);
 }
 
 static inline void op_ld_i_vx(Cpu *cpu, u8 x)
 {
-    memcpy(&cpu->memory[cpu->index_register], cpu->value_registers, x + 1);
+    for (u8 i = 0; i <= x; i++)
+    {
+        if (!write_memory(cpu, cpu->index_register + i, cpu->value_registers[i]))
+        {
+            raise_fault(cpu, CPU_FAULT_OUT_OF_MEMORY);
+            return;
+        }
+    }
 }
 
 static inline void op_ld_vx_i(Cpu *cpu, u8 x)
 {
-    memcpy(cpu->value_registers, &cpu->memory[cpu->index_register], x + 1);
+    memory_read_block(&cpu->memory, cpu->index_register, cpu->value_registers, x + 1);
 }
 
 void op_ld_vx_key(Cpu *cpu, u8 x)
@@ -625,6 +1368,7 @@ void op_ld_vx_key(Cpu *cpu, u8 x)
     if (!keyboard_is_any_key_pressed(&cpu->keyboard))
     {
         move_program_counter_backward(cpu);
+        cpu->stats.key_waits++;
         return;
     }
 
@@ -700,10 +1444,35 @@ static inline void op_shl_vx(Cpu *cpu, u8 x)
 
 static inline void op_rnd_vx_kk(Cpu *cpu, u8 x, u8 kk)
 {
-    cpu->value_registers[x] = (rand() % 255) & kk;
+    cpu->value_registers[x] = (next_random(cpu) % 255) & kk;
 }
 
 static inline void op_drw_vx_vy_n(Cpu *cpu, u8 x, u8 y, u8 n)
 {
-    cpu->value_registers[0x0F] = gpu_draw_sprite(&cpu->gpu, cpu->value_registers[x], cpu->value_registers[y], cpu->memory, cpu->index_register, n);
+    u8 sprite[SPRITE_CACHE_MAX_ROWS];
+    u64 expanded[SPRITE_CACHE_MAX_ROWS];
+    const u64 *rows = expanded;
+    bool hit = false;
+
+    // the cache is only allocated once the rom draws something.
+    if (cpu->sprite_cache == NULL)
+        cpu->sprite_cache = sprite_cache_create();
+
+    // without one, the rows are read and expanded on every draw.
+    if (cpu->sprite_cache != NULL)
+    {
+        rows = sprite_cache_get(cpu->sprite_cache, &cpu->memory, cpu->index_register, n, &hit);
+    }
+    else
+    {
+        memory_read_block(&cpu->memory, cpu->index_register, sprite, n);
+        gpu_expand_sprite(sprite, n, expanded);
+    }
+
+    cpu->stats.draws++;
+    cpu->stats.sprite_cache_hits += hit;
+    if (cpu->hash.enabled)
+        hash_sprite(cpu, cpu->value_registers[x], cpu->value_registers[y], rows, n);
+
+    cpu->value_registers[0x0F] = gpu_draw_expanded_sprite(cpu->gpu, cpu->value_registers[x], cpu->value_registers[y], rows, n);
 }
\ No newline at end of file
@@ -2,39 +2,175 @@
 #define __CPU_H__
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <time.h>
 #include <stdio.h>
 
 #include "types.h"
 #include "keyboard.h"
 #include "gpu.h"
+#include "memory.h"
+#include "sprite_cache.h"
+
+#define CPU_MEMORY_SIZE MEMORY_SIZE
+#define CPU_STACK_SIZE 16
+#define CPU_PROGRAM_START 0x200
+#define CPU_RANDOM_SEED 0x2545F491
+
+/**
+ * Why a batch started by cpu_run returned.
+ * Every reason but CPU_STOP_CYCLES returns right after the instruction
+ * that caused it, except breakpoints which stop before it.
+ * CPU_STOP_TIMER_WAIT means the rom is spinning on the delay timer (see
+ * cpu_is_waiting_on_timer): nothing changes until the next timer tick.
+ */
+typedef enum CpuStopReason
+{
+    CPU_STOP_CYCLES,
+    CPU_STOP_DRAW,
+    CPU_STOP_SOUND,
+    CPU_STOP_KEY_WAIT,
+    CPU_STOP_BREAKPOINT,
+    CPU_STOP_FAULT,
+    CPU_STOP_TIMER_WAIT
+} CpuStopReason;
+
+/**
+ * Errors that halt the cpu until it's reset.
+ * Memory accesses never fault: every address, including the program
+ * counter and anything read or written through I, wraps around the 4 KB
+ * address space. The stack has no sensible wrap, so a CALL with a full
+ * stack or a RET with an empty one traps instead, leaving the program
+ * counter on the faulting instruction. A write (Fx33, Fx55) to a shared
+ * page whose private copy can't be allocated traps the same way.
+ */
+typedef enum CpuFault
+{
+    CPU_FAULT_NONE,
+    CPU_FAULT_STACK_OVERFLOW,
+    CPU_FAULT_STACK_UNDERFLOW,
+    CPU_FAULT_OUT_OF_MEMORY
+} CpuFault;
+
+/**
+ * Counters collected by the batched runner.
+ * Used to measure how often fused macro-ops and cached sprites are hit,
+ * and how the rom spends its time: timer polls are delay timer reads
+ * (Fx07) and key waits are Fx0A executions with no key pressed.
+ */
+typedef struct CpuStats
+{
+    u64 instructions;
+    u64 fused_instructions;
+    u64 draws;
+    u64 sprite_cache_hits;
+    u64 timer_polls;
+    u64 key_waits;
+} CpuStats;
+
+/**
+ * An incremental hash of the cpu state, kept once enabled: memory writes
+ * and flipped pixels are folded in as they happen, so hashing a state
+ * never reads the whole memory or framebuffer. The registers are only
+ * folded in by cpu_get_state_hash.
+ */
+typedef struct CpuHash
+{
+    u64 memory;
+    u64 framebuffer;
+    bool enabled;
+} CpuHash;
 
 /**
  * Defines a cpu device.
  * The main processing unit.
+ * The state every instruction touches (registers, program counter, I,
+ * stack, timers and keys) fills the first cache line on its own; the
+ * struct is line aligned, so running many instances only pulls in one
+ * line each besides the page table and the pages the rom uses. The
+ * framebuffer is allocated apart, it's only read by draws and the
+ * frontends (see cpu_get_gpu).
+ * The memory is paged and may be shared with other instances running
+ * the same rom image, see cpu_load_image.
  */
 typedef struct Cpu
 {
-    u8 memory[4096];
     u8 value_registers[16];
-    u16 stack[16];
     u16 program_counter;
-    u8 stack_pointer;
     u16 index_register;
-    u8 sound_timer;
+    u8 stack_pointer;
     u8 delay_timer;
-    Gpu gpu;
+    u8 sound_timer;
+    // a CpuFault, stored in a byte so the stack still fits the first line.
+    u8 fault;
     Keyboard keyboard;
-} Cpu;
+    u32 random_state;
+    u16 stack[CPU_STACK_SIZE];
+    Memory memory;
+    CpuHash hash;
+    Gpu *gpu;
+    u8 *breakpoints;
+    SpriteCache *sprite_cache;
+    CpuStats stats;
+} __attribute__((aligned(MEMORY_CACHE_LINE_SIZE))) Cpu;
+
+_Static_assert(offsetof(Cpu, memory) == MEMORY_CACHE_LINE_SIZE, "the hot state must fill exactly the first line");
+
+/**
+ * A saved copy of the cpu state, used to rewind speculative frames.
+ * Only the pages the cpu made private are copied, along with their
+ * fused macro-op tags; the rest still matches the shared image.
+ * A state can only be loaded back into the cpu it was saved from.
+ */
+typedef struct CpuState
+{
+    u8 registers[offsetof(Cpu, memory)];
+    CpuHash hash;
+    Gpu gpu;
+    u16 private_pages;
+    MemoryPage pages[MEMORY_PAGE_COUNT];
+} CpuState;
+
+bool cpu_init(Cpu *cpu);
+
+void cpu_free(Cpu *cpu);
 
 void cpu_reset(Cpu *cpu);
 
 void cpu_load_rom(Cpu* cpu, const char* file_name);
 
+bool cpu_load_rom_from_memory(Cpu* cpu, const u8* rom, u32 size);
+
+MemoryImage* cpu_create_image(const u8* rom, u32 size);
+
+void cpu_load_image(Cpu* cpu, MemoryImage* image);
+
+u8 cpu_read_memory(const Cpu* cpu, u16 address);
+
+bool cpu_write_memory(Cpu* cpu, u16 address, u8 value);
+
+void cpu_write_framebuffer(Cpu* cpu, const u8* frame);
+
 void cpu_execute_op(Cpu* cpu, const u16 op_code);
 
 void cpu_clock(Cpu* cpu);
 
+void cpu_tick_timers(Cpu* cpu);
+
+u32 cpu_run(Cpu* cpu, u32 cycles, CpuStopReason* stop_reason);
+
+void cpu_set_breakpoint(Cpu* cpu, u16 address, bool enabled);
+
+bool cpu_has_breakpoint(const Cpu* cpu, u16 address);
+
+f32 cpu_get_fused_hit_rate(const Cpu* cpu);
+
+f32 cpu_get_sprite_cache_hit_rate(const Cpu* cpu);
+
+void cpu_save_state(const Cpu* cpu, CpuState* state);
+
+void cpu_load_state(Cpu* cpu, const CpuState* state);
+
 void cpu_disassemble_op(const Cpu* cpu, const u16 op_code, char* instruction);
 
 u32 cpu_disassemble_code(const Cpu* cpu, char*** instructions);
@@ -43,4 +179,14 @@ void cpu_free_disassembled_code(char*** instructions, u32 count);
 
 u16 cpu_get_instruction_pointer_index(const Cpu* cpu);
 
+void cpu_find_reachable_code(const u8* memory, bool* reachable);
+
+bool cpu_is_waiting_on_timer(const Cpu* cpu);
+
+void cpu_enable_state_hash(Cpu* cpu, bool enabled);
+
+u64 cpu_get_state_hash(const Cpu* cpu);
+
+const Gpu* cpu_get_gpu(const Cpu* cpu);
+
 #endif /*__CPU_H__*/
\ No newline at end of file
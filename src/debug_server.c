@@ -0,0 +1,542 @@
+#include "debug_server.h"
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#ifdef MSG_NOSIGNAL
+#define DEBUG_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define DEBUG_SEND_FLAGS 0
+#endif
+
+static void accept_client(DebugServer *server);
+static void close_client(DebugServer *server);
+static i32 receive_request(DebugServer *server);
+static i32 handle_request(DebugServer *server);
+static u8 execute_request(DebugServer *server, u8 command, const u8 *payload, u16 size, u8 *response, u16 *response_size);
+static u32 run_cycles(DebugServer *server, u32 cycles, u16 cycles_per_frame, CpuStopReason *reason);
+static u16 write_state(DebugServer *server, u32 executed, CpuStopReason reason, u8 *output);
+static bool send_all(i32 socket, const u8 *data, u32 size);
+static bool receive_all(i32 socket, u8 *data, u32 size);
+static inline u16 read_u16(const u8 *data);
+static inline u32 read_u32(const u8 *data);
+static inline void write_u16(u8 *data, u16 value);
+static inline void write_u32(u8 *data, u32 value);
+
+DebugServer *debug_server_create(const char *path, Cpu *cpu)
+{
+    struct sockaddr_un address;
+    DebugServer *server;
+
+    if (strlen(path) >= sizeof(address.sun_path) || strlen(path) >= sizeof(server->path))
+        return NULL;
+
+    server = calloc(1, sizeof(DebugServer));
+
+    if (server == NULL)
+        return NULL;
+
+    server->cpu = cpu;
+    server->client = -1;
+    server->cycles_per_frame = DEBUG_CYCLES_PER_FRAME;
+    memcpy(server->path, path, strlen(path) + 1);
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path, strlen(path) + 1);
+
+    // a socket left behind by a server that didn't exit cleanly.
+    unlink(path);
+
+    server->listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (server->listener < 0 ||
+        bind(server->listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(server->listener, 1) != 0)
+    {
+        if (server->listener >= 0)
+            close(server->listener);
+
+        free(server);
+        return NULL;
+    }
+
+    return server;
+}
+
+void debug_server_free(DebugServer *server)
+{
+    if (server == NULL)
+        return;
+
+    close_client(server);
+    close(server->listener);
+    unlink(server->path);
+    free(server);
+}
+
+u32 debug_server_poll(DebugServer *server, i32 timeout)
+{
+    // poll skips negative descriptors, so there's no need to leave out the
+    // client slot while nobody is connected.
+    struct pollfd descriptors[2] = {{server->listener, POLLIN, 0}, {server->client, POLLIN, 0}};
+    u32 handled = 0;
+
+    if (poll(descriptors, 2, timeout) <= 0)
+        return 0;
+
+    // requests are handled until the client has nothing more to send, so a
+    // scripted session isn't paced by the caller's loop.
+    while (server->client >= 0 && descriptors[1].revents != 0)
+    {
+        i32 result = handle_request(server);
+
+        if (result < 0)
+            close_client(server);
+
+        // the rest of a partial request is read on a later poll.
+        if (result <= 0)
+            break;
+
+        handled++;
+        descriptors[1].revents = 0;
+
+        if (poll(&descriptors[1], 1, 0) <= 0)
+            break;
+    }
+
+    if (descriptors[0].revents & POLLIN)
+        accept_client(server);
+
+    return handled;
+}
+
+void debug_pack_registers(const Cpu *cpu, u8 *registers)
+{
+    memcpy(registers + DEBUG_REGISTER_V, cpu->value_registers, 16);
+    write_u16(registers + DEBUG_REGISTER_I, cpu->index_register);
+    write_u16(registers + DEBUG_REGISTER_PC, cpu->program_counter);
+    registers[DEBUG_REGISTER_SP] = cpu->stack_pointer;
+    registers[DEBUG_REGISTER_DT] = cpu->delay_timer;
+    registers[DEBUG_REGISTER_ST] = cpu->sound_timer;
+    registers[DEBUG_REGISTER_FAULT] = cpu->fault;
+
+    for (u8 i = 0; i < CPU_STACK_SIZE; i++)
+        write_u16(registers + DEBUG_REGISTER_STACK + i * 2, cpu->stack[i]);
+}
+
+void debug_unpack_registers(Cpu *cpu, const u8 *registers)
+{
+    u8 fault = registers[DEBUG_REGISTER_FAULT];
+
+    memcpy(cpu->value_registers, registers + DEBUG_REGISTER_V, 16);
+    cpu->index_register = read_u16(registers + DEBUG_REGISTER_I);
+    cpu->program_counter = read_u16(registers + DEBUG_REGISTER_PC) & (CPU_MEMORY_SIZE - 1);
+    cpu->delay_timer = registers[DEBUG_REGISTER_DT];
+    cpu->sound_timer = registers[DEBUG_REGISTER_ST];
+
+    // out of range values are clamped to ones the cpu can run with; writing
+    // a zero fault is how a halted cpu is resumed.
+    cpu->stack_pointer = registers[DEBUG_REGISTER_SP] > CPU_STACK_SIZE ? CPU_STACK_SIZE : registers[DEBUG_REGISTER_SP];
+    cpu->fault = fault <= CPU_FAULT_OUT_OF_MEMORY ? (CpuFault)fault : CPU_FAULT_NONE;
+
+    for (u8 i = 0; i < CPU_STACK_SIZE; i++)
+        cpu->stack[i] = read_u16(registers + DEBUG_REGISTER_STACK + i * 2);
+}
+
+u16 debug_encode_delta(u8 *previous, const u8 *current, u16 size, u8 block, u8 *output)
+{
+    // size must be a multiple of block, and at most 32 blocks long. The
+    // previous state becomes the current one.
+    u32 mask = 0;
+    u16 written = 4;
+
+    for (u16 i = 0, bit = 0; i < size; i += block, bit++)
+    {
+        if (memcmp(previous + i, current + i, block) == 0)
+            continue;
+
+        mask |= 1u << bit;
+        memcpy(output + written, current + i, block);
+        memcpy(previous + i, current + i, block);
+        written += block;
+    }
+
+    write_u32(output, mask);
+    return written;
+}
+
+i32 debug_decode_delta(u8 *state, u16 size, u8 block, const u8 *input, u16 input_size)
+{
+    if (input_size < 4)
+        return -1;
+
+    u32 mask = read_u32(input);
+    u16 read = 4;
+
+    for (u16 i = 0, bit = 0; i < size; i += block, bit++)
+    {
+        if ((mask & (1u << bit)) == 0)
+            continue;
+
+        if (read + block > input_size)
+            return -1;
+
+        memcpy(state + i, input + read, block);
+        read += block;
+    }
+
+    return read;
+}
+
+bool debug_send_message(i32 socket, u8 command, u8 status, const u8 *payload, u16 size)
+{
+    u8 header[DEBUG_HEADER_SIZE] = {command, status, size & 0xFF, size >> 8};
+    struct iovec parts[2] = {{header, DEBUG_HEADER_SIZE}, {(void *)payload, size}};
+    struct msghdr message = {0};
+    ssize_t sent;
+
+    message.msg_iov = parts;
+    message.msg_iovlen = size > 0 ? 2 : 1;
+
+    // the header and the payload leave in a single call, whatever a short
+    // write left behind is sent after.
+    do
+    {
+        sent = sendmsg(socket, &message, DEBUG_SEND_FLAGS);
+    } while (sent < 0 && errno == EINTR);
+
+    if (sent < 0)
+        return false;
+
+    if (sent < DEBUG_HEADER_SIZE)
+        return send_all(socket, header + sent, DEBUG_HEADER_SIZE - sent) && send_all(socket, payload, size);
+
+    return send_all(socket, payload + (sent - DEBUG_HEADER_SIZE), size - (sent - DEBUG_HEADER_SIZE));
+}
+
+bool debug_receive_message(i32 socket, u8 *command, u8 *status, u8 *payload, u16 *size)
+{
+    u8 header[DEBUG_HEADER_SIZE];
+
+    if (!receive_all(socket, header, DEBUG_HEADER_SIZE))
+        return false;
+
+    *command = header[0];
+    *status = header[1];
+    *size = read_u16(header + 2);
+
+    return *size <= DEBUG_MAX_PAYLOAD && receive_all(socket, payload, *size);
+}
+
+static void accept_client(DebugServer *server)
+{
+    i32 client = accept(server->listener, NULL, NULL);
+
+    if (client < 0)
+        return;
+
+    // one client at a time, the others are turned away.
+    if (server->client >= 0)
+    {
+        close(client);
+        return;
+    }
+
+    // a client that stops reading its responses can't hold the loop.
+    struct timeval timeout = {DEBUG_SEND_TIMEOUT_MS / 1000, (DEBUG_SEND_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // a new client knows nothing yet, the first state it asks for is sent
+    // whole as a delta against zeros.
+    server->client = client;
+    server->frame_cycles = 0;
+    server->received = 0;
+    memset(server->registers, 0, sizeof(server->registers));
+    memset(server->framebuffer, 0, sizeof(server->framebuffer));
+}
+
+static void close_client(DebugServer *server)
+{
+    if (server->client < 0)
+        return;
+
+    close(server->client);
+    server->client = -1;
+}
+
+static i32 receive_request(DebugServer *server)
+{
+    u32 needed = DEBUG_HEADER_SIZE;
+
+    if (server->received >= DEBUG_HEADER_SIZE)
+        needed += read_u16(server->request + 2);
+
+    while (server->received < needed)
+    {
+        ssize_t received = recv(server->client, server->request + server->received, needed - server->received, MSG_DONTWAIT);
+
+        if (received < 0 && errno == EINTR)
+            continue;
+
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 0;
+
+        if (received <= 0)
+            return -1;
+
+        server->received += received;
+
+        // the header is in, the payload size is known.
+        if (needed == DEBUG_HEADER_SIZE && server->received == DEBUG_HEADER_SIZE)
+        {
+            if (read_u16(server->request + 2) > DEBUG_MAX_PAYLOAD)
+                return -1;
+
+            needed += read_u16(server->request + 2);
+        }
+    }
+
+    return 1;
+}
+
+static i32 handle_request(DebugServer *server)
+{
+    u16 response_size = 0;
+    i32 result = receive_request(server);
+
+    if (result <= 0)
+        return result;
+
+    u8 command = server->request[0];
+    u8 status = execute_request(server, command, server->request + DEBUG_HEADER_SIZE, read_u16(server->request + 2),
+                                server->response, &response_size);
+
+    server->received = 0;
+    return debug_send_message(server->client, command, status, server->response, response_size) ? 1 : -1;
+}
+
+static u8 execute_request(DebugServer *server, u8 command, const u8 *payload, u16 size, u8 *response, u16 *response_size)
+{
+    Cpu *cpu = server->cpu;
+    CpuStopReason reason = CPU_STOP_CYCLES;
+    u32 executed;
+    u8 registers[DEBUG_REGISTERS_SIZE];
+
+    switch (command)
+    {
+    case DEBUG_STEP:
+        if (size != 4 && size != 6)
+            return DEBUG_ERROR_PAYLOAD;
+
+        executed = run_cycles(server, read_u32(payload), size == 6 ? read_u16(payload + 4) : server->cycles_per_frame,
+                              NULL);
+        reason = cpu->fault != CPU_FAULT_NONE ? CPU_STOP_FAULT : CPU_STOP_CYCLES;
+        *response_size = write_state(server, executed, reason, response);
+        return DEBUG_OK;
+
+    case DEBUG_RUN:
+        if (size != 6)
+            return DEBUG_ERROR_PAYLOAD;
+
+        executed = run_cycles(server, read_u32(payload), read_u16(payload + 4), &reason);
+        *response_size = write_state(server, executed, reason, response);
+        return DEBUG_OK;
+
+    case DEBUG_STATE:
+        if (size != 0)
+            return DEBUG_ERROR_PAYLOAD;
+
+        *response_size = write_state(server, 0, cpu->fault != CPU_FAULT_NONE ? CPU_STOP_FAULT : CPU_STOP_CYCLES, response);
+        return DEBUG_OK;
+
+    case DEBUG_READ_MEMORY:
+        if (size != 4 || read_u16(payload + 2) > CPU_MEMORY_SIZE)
+            return DEBUG_ERROR_PAYLOAD;
+
+        *response_size = read_u16(payload + 2);
+        memory_read_block(&cpu->memory, read_u16(payload) & (CPU_MEMORY_SIZE - 1), response, *response_size);
+        return DEBUG_OK;
+
+    case DEBUG_WRITE_MEMORY:
+        if (size < 2 || size - 2 > CPU_MEMORY_SIZE)
+            return DEBUG_ERROR_PAYLOAD;
+
+        // through the cpu, so fused pairs and cached sprites over the
+        // written bytes are dropped.
+        for (u16 i = 0; i < size - 2; i++)
+        {
+            if (!cpu_write_memory(cpu, (read_u16(payload) + i) & (CPU_MEMORY_SIZE - 1), payload[2 + i]))
+                return DEBUG_ERROR_MEMORY;
+        }
+
+        return DEBUG_OK;
+
+    case DEBUG_WRITE_REGISTERS:
+        memcpy(registers, server->registers, sizeof(registers));
+
+        if (debug_decode_delta(registers, DEBUG_REGISTERS_SIZE, DEBUG_REGISTERS_BLOCK, payload, size) != size)
+            return DEBUG_ERROR_PAYLOAD;
+
+        debug_unpack_registers(cpu, registers);
+        return DEBUG_OK;
+
+    case DEBUG_BREAKPOINT:
+        if (size != 3)
+            return DEBUG_ERROR_PAYLOAD;
+
+        cpu_set_breakpoint(cpu, read_u16(payload), payload[2] != 0);
+        return DEBUG_OK;
+
+    case DEBUG_KEYS:
+        if (size != 2)
+            return DEBUG_ERROR_PAYLOAD;
+
+        cpu->keyboard.memory = read_u16(payload);
+        return DEBUG_OK;
+
+    case DEBUG_WRITE_FRAMEBUFFER:
+        if (size != GPU_PACKED_FRAME_SIZE)
+            return DEBUG_ERROR_PAYLOAD;
+
+        // the client holds the frame it wrote, so it's the base of the
+        // next delta.
+        cpu_write_framebuffer(cpu, payload);
+        memcpy(server->framebuffer, payload, GPU_PACKED_FRAME_SIZE);
+        return DEBUG_OK;
+    }
+
+    return DEBUG_ERROR_COMMAND;
+}
+
+static u32 run_cycles(DebugServer *server, u32 cycles, u16 cycles_per_frame, CpuStopReason *reason)
+{
+    u32 executed = 0;
+
+    // the frame in progress was counted against another length, it starts
+    // over so it can't be past the end of the new one.
+    if (cycles_per_frame != server->cycles_per_frame)
+    {
+        server->cycles_per_frame = cycles_per_frame;
+        server->frame_cycles = 0;
+    }
+
+    while (executed < cycles)
+    {
+        u32 batch = cycles - executed;
+
+        // the timers tick on frame boundaries, counted across requests.
+        if (cycles_per_frame > 0 && batch > cycles_per_frame - server->frame_cycles)
+            batch = cycles_per_frame - server->frame_cycles;
+
+        u32 count = cpu_run(server->cpu, batch, reason);
+        executed += count;
+        server->frame_cycles += count;
+
+        if (cycles_per_frame > 0 && server->frame_cycles >= cycles_per_frame)
+        {
+            cpu_tick_timers(server->cpu);
+            server->frame_cycles = 0;
+        }
+
+        // steps, with no reason, only stop on a fault.
+        if (reason == NULL ? server->cpu->fault != CPU_FAULT_NONE
+                           : *reason == CPU_STOP_BREAKPOINT || *reason == CPU_STOP_KEY_WAIT || *reason == CPU_STOP_FAULT)
+            return executed;
+    }
+
+    // draws and sound starts don't stop a run.
+    if (reason != NULL)
+        *reason = CPU_STOP_CYCLES;
+
+    return executed;
+}
+
+static u16 write_state(DebugServer *server, u32 executed, CpuStopReason reason, u8 *output)
+{
+    u8 registers[DEBUG_REGISTERS_SIZE];
+    u8 framebuffer[GPU_PACKED_FRAME_SIZE];
+    u16 size = 5;
+
+    write_u32(output, executed);
+    output[4] = reason;
+
+    debug_pack_registers(server->cpu, registers);
+    gpu_pack_frame(cpu_get_gpu(server->cpu), framebuffer);
+
+    size += debug_encode_delta(server->registers, registers, DEBUG_REGISTERS_SIZE, DEBUG_REGISTERS_BLOCK, output + size);
+    size += debug_encode_delta(server->framebuffer, framebuffer, GPU_PACKED_FRAME_SIZE, DEBUG_FRAMEBUFFER_BLOCK, output + size);
+
+    return size;
+}
+
+static bool send_all(i32 socket, const u8 *data, u32 size)
+{
+    while (size > 0)
+    {
+        ssize_t sent = send(socket, data, size, DEBUG_SEND_FLAGS);
+
+        if (sent < 0 && errno == EINTR)
+            continue;
+
+        if (sent <= 0)
+            return false;
+
+        data += sent;
+        size -= sent;
+    }
+
+    return true;
+}
+
+static bool receive_all(i32 socket, u8 *data, u32 size)
+{
+    while (size > 0)
+    {
+        ssize_t received = recv(socket, data, size, MSG_WAITALL);
+
+        if (received < 0 && errno == EINTR)
+            continue;
+
+        if (received <= 0)
+            return false;
+
+        data += received;
+        size -= received;
+    }
+
+    return true;
+}
+
+static inline u16 read_u16(const u8 *data)
+{
+    return data[0] | (data[1] << 8);
+}
+
+static inline u32 read_u32(const u8 *data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((u32)data[3] << 24);
+}
+
+static inline void write_u16(u8 *data, u16 value)
+{
+    data[0] = value & 0xFF;
+    data[1] = value >> 8;
+}
+
+static inline void write_u32(u8 *data, u32 value)
+{
+    data[0] = value & 0xFF;
+    data[1] = (value >> 8) & 0xFF;
+    data[2] = (value >> 16) & 0xFF;
+    data[3] = value >> 24;
+}
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef __DEBUG_SERVER_H__
+#define __DEBUG_SERVER_H__
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "types.h"
+#include "cpu.h"
+
+/**
+ * Debug protocol.
+ *
+ * Every message, request or response, is a 4 byte header followed by its
+ * payload: u8 command, u8 status (DEBUG_OK in requests), u16 payload size.
+ * Numbers are little endian. Responses echo the command of the request.
+ *
+ *  - DEBUG_STEP {u32 count[, u16 cycles_per_frame]}: runs count
+ *    instructions, ignoring breakpoints, until a fault. The timers tick
+ *    as in DEBUG_RUN, every cycles_per_frame or, when left out, every
+ *    frame length of the last run (DEBUG_CYCLES_PER_FRAME before any).
+ *  - DEBUG_RUN {u32 cycles, u16 cycles_per_frame}: runs up to cycles
+ *    instructions, ticking the timers every cycles_per_frame (never when
+ *    0), until a breakpoint, a key wait or a fault.
+ *  - DEBUG_STATE {}: only reports the state.
+ *
+ *    The three of them answer {u32 executed, u8 stop reason, registers
+ *    delta, framebuffer delta}: see debug_encode_delta.
+ *
+ *  - DEBUG_READ_MEMORY {u16 address, u16 length}: answers the bytes.
+ *  - DEBUG_WRITE_MEMORY {u16 address, bytes}: answers nothing, or
+ *    DEBUG_ERROR_MEMORY when a page couldn't be copied; the bytes
+ *    before it are written.
+ *  - DEBUG_WRITE_REGISTERS {registers delta}: against the registers the
+ *    server last reported, answers nothing.
+ *  - DEBUG_BREAKPOINT {u16 address, u8 enabled}: answers nothing.
+ *  - DEBUG_KEYS {u16 keys}: sets the pressed keys, one bit each.
+ *  - DEBUG_WRITE_FRAMEBUFFER {packed frame}: replaces the framebuffer
+ *    (see gpu_pack_frame), answers nothing. The written frame counts as
+ *    reported, the next delta is against it.
+ *
+ * Addresses wrap around the memory.
+ */
+#define DEBUG_HEADER_SIZE 4
+#define DEBUG_MAX_PAYLOAD (CPU_MEMORY_SIZE + 16)
+#define DEBUG_SEND_TIMEOUT_MS 1000
+#define DEBUG_CYCLES_PER_FRAME 10
+
+#define DEBUG_STEP 0x01
+#define DEBUG_RUN 0x02
+#define DEBUG_STATE 0x03
+#define DEBUG_READ_MEMORY 0x04
+#define DEBUG_WRITE_MEMORY 0x05
+#define DEBUG_WRITE_REGISTERS 0x06
+#define DEBUG_BREAKPOINT 0x07
+#define DEBUG_KEYS 0x08
+#define DEBUG_WRITE_FRAMEBUFFER 0x09
+
+#define DEBUG_OK 0
+#define DEBUG_ERROR_COMMAND 1
+#define DEBUG_ERROR_PAYLOAD 2
+#define DEBUG_ERROR_MEMORY 3
+
+/**
+ * The registers as sent over the wire, 56 bytes: V0-VF, I, PC, SP, DT,
+ * ST, the fault and the 16 stack entries.
+ */
+#define DEBUG_REGISTER_V 0
+#define DEBUG_REGISTER_I 16
+#define DEBUG_REGISTER_PC 18
+#define DEBUG_REGISTER_SP 20
+#define DEBUG_REGISTER_DT 21
+#define DEBUG_REGISTER_ST 22
+#define DEBUG_REGISTER_FAULT 23
+#define DEBUG_REGISTER_STACK 24
+#define DEBUG_REGISTERS_SIZE (DEBUG_REGISTER_STACK + CPU_STACK_SIZE * 2)
+
+/**
+ * Deltas are a u32 mask of the blocks that changed, followed by those
+ * blocks in order. Registers are sent in blocks of 2 bytes, the packed
+ * framebuffer (see gpu_pack_frame) in blocks of 8.
+ */
+#define DEBUG_REGISTERS_BLOCK 2
+#define DEBUG_FRAMEBUFFER_BLOCK 8
+
+/**
+ * Defines a debug server.
+ * Listens on a unix domain socket and serves one client at a time; the
+ * requests are handled on the thread calling debug_server_poll, so it can
+ * be polled from the same loop that runs the cpu. Requests are read
+ * without blocking and kept until they're complete, so a slow client
+ * never stalls the loop; a client that doesn't read its responses is
+ * dropped after DEBUG_SEND_TIMEOUT_MS. The server keeps the state it last
+ * reported, to only send what changed since.
+ * Not available on Windows.
+ */
+typedef struct DebugServer
+{
+    Cpu *cpu;
+    i32 listener;
+    i32 client;
+    u32 frame_cycles;
+    u16 cycles_per_frame;
+    u32 received;
+    char path[108];
+    u8 registers[DEBUG_REGISTERS_SIZE];
+    u8 framebuffer[GPU_PACKED_FRAME_SIZE];
+    u8 request[DEBUG_HEADER_SIZE + DEBUG_MAX_PAYLOAD];
+    u8 response[DEBUG_HEADER_SIZE + DEBUG_MAX_PAYLOAD];
+} DebugServer;
+
+DebugServer *debug_server_create(const char *path, Cpu *cpu);
+
+void debug_server_free(DebugServer *server);
+
+u32 debug_server_poll(DebugServer *server, i32 timeout);
+
+void debug_pack_registers(const Cpu *cpu, u8 *registers);
+
+void debug_unpack_registers(Cpu *cpu, const u8 *registers);
+
+u16 debug_encode_delta(u8 *previous, const u8 *current, u16 size, u8 block, u8 *output);
+
+i32 debug_decode_delta(u8 *state, u16 size, u8 block, const u8 *input, u16 input_size);
+
+bool debug_send_message(i32 socket, u8 command, u8 status, const u8 *payload, u16 size);
+
+bool debug_receive_message(i32 socket, u8 *command, u8 *status, u8 *payload, u16 *size);
+
+#endif /*__DEBUG_SERVER_H__*/
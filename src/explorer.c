@@ -0,0 +1,411 @@
+#include "explorer.h"
+
+#define EXPLORER_INPUTS_MAGIC "c8inputs"
+#define EXPLORER_VISITED_CAPACITY 65536
+
+static ExplorerFinding run_step(Cpu *cpu, u16 keys, u16 cycles_per_frame, const bool *reachable, u8 *coverage,
+                                u32 *new_coverage, u16 *address);
+static ExplorerEntry *pick_entry(Explorer *explorer);
+static void add_entry(Explorer *explorer, u32 score);
+static bool visit(Explorer *explorer, u64 hash);
+static bool grow_visited(Explorer *explorer);
+static u16 mutate_keys(Explorer *explorer, u16 previous);
+static u32 next_random(Explorer *explorer);
+static void find_reachable_code(const Cpu *cpu, bool *reachable);
+
+Explorer *explorer_create(const u8 *rom, u32 size, u16 cycles_per_frame, u32 seed)
+{
+    Explorer *explorer = memory_allocate_aligned(sizeof(Explorer));
+
+    if (explorer == NULL)
+        return NULL;
+
+    explorer->cycles_per_frame = cycles_per_frame;
+    explorer->random_state = seed != 0 ? seed : 1;
+    explorer->entries = calloc(EXPLORER_MAX_ENTRIES, sizeof(ExplorerEntry));
+
+    if (!cpu_init(&explorer->cpu) || !cpu_load_rom_from_memory(&explorer->cpu, rom, size))
+    {
+        explorer_free(explorer);
+        return NULL;
+    }
+
+    cpu_enable_state_hash(&explorer->cpu, true);
+    find_reachable_code(&explorer->cpu, explorer->reachable);
+
+    for (u32 i = 0; i < CPU_MEMORY_SIZE; i++)
+        explorer->stats.reachable += explorer->reachable[i];
+
+    if (explorer->entries == NULL || !grow_visited(explorer))
+    {
+        explorer_free(explorer);
+        return NULL;
+    }
+
+    // the reset state is the root every input sequence starts from.
+    visit(explorer, cpu_get_state_hash(&explorer->cpu));
+    add_entry(explorer, 0);
+
+    return explorer;
+}
+
+void explorer_free(Explorer *explorer)
+{
+    if (explorer == NULL)
+        return;
+
+    for (u32 i = 0; i < explorer->entry_count; i++)
+        free(explorer->entries[i].inputs);
+
+    cpu_free(&explorer->cpu);
+    free(explorer->entries);
+    free(explorer->visited);
+    memory_free_aligned(explorer);
+}
+
+ExplorerFinding explorer_run(Explorer *explorer)
+{
+    ExplorerEntry *entry = pick_entry(explorer);
+    ExplorerFinding finding = EXPLORER_NONE;
+    u32 new_coverage = 0;
+    u32 new_states = 0;
+    bool new_state = false;
+
+    cpu_load_state(&explorer->cpu, &entry->state);
+    memcpy(explorer->inputs, entry->inputs, entry->input_count * sizeof(u16));
+    explorer->input_count = entry->input_count;
+    entry->picks++;
+
+    u32 steps = 1 + next_random(explorer) % EXPLORER_MUTATION_STEPS;
+
+    for (u32 i = 0; i < steps && explorer->input_count < EXPLORER_MAX_STEPS; i++)
+    {
+        u16 keys = mutate_keys(explorer, explorer->input_count > 0 ? explorer->inputs[explorer->input_count - 1] : 0);
+        u16 address;
+        u64 executed = explorer->cpu.stats.instructions;
+
+        explorer->inputs[explorer->input_count++] = keys;
+
+        ExplorerFinding step_finding = run_step(&explorer->cpu, keys, explorer->cycles_per_frame, explorer->reachable,
+                                                explorer->coverage, &new_coverage, &address);
+
+        explorer->stats.steps++;
+        explorer->stats.instructions += explorer->cpu.stats.instructions - executed;
+        new_state = visit(explorer, cpu_get_state_hash(&explorer->cpu));
+        new_states += new_state;
+
+        // a finding is only reported the first time, and the inputs stop
+        // at the step it happened in, so they replay straight to it.
+        if (step_finding != EXPLORER_NONE)
+        {
+            u8 *reported = explorer->reported[step_finding - 1];
+
+            if ((reported[address / 8] & (1 << (address % 8))) == 0)
+            {
+                reported[address / 8] |= 1 << (address % 8);
+                explorer->finding_address = address;
+                explorer->stats.findings++;
+                finding = step_finding;
+                break;
+            }
+        }
+
+        if (explorer->cpu.fault != CPU_FAULT_NONE)
+            break;
+    }
+
+    explorer->stats.runs++;
+    explorer->stats.covered += new_coverage;
+
+    // a faulted state has nowhere to go, only its inputs are worth keeping.
+    if ((new_coverage > 0 || new_state) && explorer->cpu.fault == CPU_FAULT_NONE)
+        add_entry(explorer, new_coverage * EXPLORER_COVERAGE_SCORE + new_states);
+
+    return finding;
+}
+
+const u16 *explorer_get_inputs(const Explorer *explorer, u32 *count)
+{
+    *count = explorer->input_count;
+    return explorer->inputs;
+}
+
+ExplorerFinding explorer_replay(Cpu *cpu, const u16 *inputs, u32 count, u16 cycles_per_frame)
+{
+    bool *reachable = malloc(CPU_MEMORY_SIZE * sizeof(bool));
+    ExplorerFinding finding = EXPLORER_NONE;
+
+    if (reachable == NULL)
+        return EXPLORER_NONE;
+
+    find_reachable_code(cpu, reachable);
+
+    // faults end the replay, code the analysis didn't reach is only
+    // reported if nothing faults after it.
+    for (u32 i = 0; i < count && cpu->fault == CPU_FAULT_NONE; i++)
+    {
+        u16 address;
+        ExplorerFinding step_finding = run_step(cpu, inputs[i], cycles_per_frame, reachable, NULL, NULL, &address);
+
+        if (step_finding != EXPLORER_NONE && (finding == EXPLORER_NONE || step_finding != EXPLORER_UNREACHED_CODE))
+            finding = step_finding;
+    }
+
+    free(reachable);
+    return finding;
+}
+
+const char *explorer_get_finding_name(ExplorerFinding finding)
+{
+    switch (finding)
+    {
+    case EXPLORER_STACK_OVERFLOW:
+        return "overflow";
+    case EXPLORER_STACK_UNDERFLOW:
+        return "underflow";
+    case EXPLORER_UNREACHED_CODE:
+        return "unreached";
+    default:
+        return "none";
+    }
+}
+
+bool explorer_save_inputs(const char *file_name, const u16 *inputs, u32 count, u16 cycles_per_frame)
+{
+    FILE *file = fopen(file_name, "wt");
+
+    if (file == NULL)
+        return false;
+
+    // one key mask per line, each held for EXPLORER_FRAMES_PER_STEP frames.
+    fprintf(file, "%s %u %u\n", EXPLORER_INPUTS_MAGIC, cycles_per_frame, EXPLORER_FRAMES_PER_STEP);
+
+    for (u32 i = 0; i < count; i++)
+        fprintf(file, "%04X\n", inputs[i]);
+
+    return fclose(file) == 0;
+}
+
+u16 *explorer_load_inputs(const char *file_name, u32 *count, u16 *cycles_per_frame)
+{
+    char magic[16];
+    u32 cycles;
+    u32 frames_per_step;
+    u32 keys;
+    FILE *file = fopen(file_name, "rt");
+
+    if (file == NULL)
+        return NULL;
+
+    u16 *inputs = malloc(EXPLORER_MAX_STEPS * sizeof(u16));
+
+    if (inputs == NULL || fscanf(file, "%15s %u %u", magic, &cycles, &frames_per_step) != 3 ||
+        strcmp(magic, EXPLORER_INPUTS_MAGIC) != 0 || frames_per_step != EXPLORER_FRAMES_PER_STEP)
+    {
+        free(inputs);
+        fclose(file);
+        return NULL;
+    }
+
+    *count = 0;
+    *cycles_per_frame = cycles;
+
+    while (*count < EXPLORER_MAX_STEPS && fscanf(file, "%x", &keys) == 1)
+        inputs[(*count)++] = keys;
+
+    fclose(file);
+    return inputs;
+}
+
+static ExplorerFinding run_step(Cpu *cpu, u16 keys, u16 cycles_per_frame, const bool *reachable, u8 *coverage,
+                                u32 *new_coverage, u16 *address)
+{
+    ExplorerFinding finding = EXPLORER_NONE;
+
+    cpu->keyboard.memory = keys;
+
+    for (u8 frame = 0; frame < EXPLORER_FRAMES_PER_STEP; frame++)
+    {
+        // one instruction at a time, to see every address that runs. The
+        // rest of a frame spent on a key or timer wait changes nothing, so
+        // it's skipped.
+        for (u16 executed = 0; executed < cycles_per_frame; executed++)
+        {
+            u16 program_counter = cpu->program_counter;
+            CpuStopReason reason;
+
+            if (coverage != NULL && (coverage[program_counter / 8] & (1 << (program_counter % 8))) == 0)
+            {
+                coverage[program_counter / 8] |= 1 << (program_counter % 8);
+                (*new_coverage)++;
+            }
+
+            if (!reachable[program_counter] && finding == EXPLORER_NONE)
+            {
+                finding = EXPLORER_UNREACHED_CODE;
+                *address = program_counter;
+            }
+
+            cpu_run(cpu, 1, &reason);
+
+            // running out of host memory says nothing about the rom.
+            if (reason == CPU_STOP_FAULT && cpu->fault == CPU_FAULT_OUT_OF_MEMORY)
+                return finding;
+
+            if (reason == CPU_STOP_FAULT)
+            {
+                *address = cpu->program_counter;
+                return cpu->fault == CPU_FAULT_STACK_OVERFLOW ? EXPLORER_STACK_OVERFLOW : EXPLORER_STACK_UNDERFLOW;
+            }
+
+            if (reason == CPU_STOP_KEY_WAIT || reason == CPU_STOP_TIMER_WAIT)
+                break;
+        }
+
+        cpu_tick_timers(cpu);
+    }
+
+    return finding;
+}
+
+static ExplorerEntry *pick_entry(Explorer *explorer)
+{
+    ExplorerEntry *a = &explorer->entries[next_random(explorer) % explorer->entry_count];
+    ExplorerEntry *b = &explorer->entries[next_random(explorer) % explorer->entry_count];
+
+    // the better of two at random: entries that found more are explored
+    // more, and every pick makes an entry less attractive.
+    return (u64)a->score * (b->picks + 1) >= (u64)b->score * (a->picks + 1) ? a : b;
+}
+
+static void add_entry(Explorer *explorer, u32 score)
+{
+    ExplorerEntry *entry;
+
+    if (explorer->entry_count < EXPLORER_MAX_ENTRIES)
+    {
+        entry = &explorer->entries[explorer->entry_count++];
+    }
+    else
+    {
+        // a full corpus replaces its least promising entry, never the root.
+        entry = &explorer->entries[1];
+
+        for (u32 i = 2; i < explorer->entry_count; i++)
+        {
+            const ExplorerEntry *candidate = &explorer->entries[i];
+
+            if ((u64)candidate->score * (entry->picks + 1) < (u64)entry->score * (candidate->picks + 1))
+                entry = &explorer->entries[i];
+        }
+
+        if ((u64)entry->score >= (u64)score * (entry->picks + 1))
+            return;
+    }
+
+    u16 *inputs = realloc(entry->inputs, (explorer->input_count > 0 ? explorer->input_count : 1) * sizeof(u16));
+
+    if (inputs == NULL)
+        return;
+
+    cpu_save_state(&explorer->cpu, &entry->state);
+    memcpy(inputs, explorer->inputs, explorer->input_count * sizeof(u16));
+    entry->inputs = inputs;
+    entry->input_count = explorer->input_count;
+    entry->score = score;
+    entry->picks = 0;
+    explorer->stats.entries = explorer->entry_count;
+}
+
+static bool visit(Explorer *explorer, u64 hash)
+{
+    // 0 marks an empty slot, so it's folded onto 1.
+    hash = hash != 0 ? hash : 1;
+
+    if (explorer->stats.states * 2 >= explorer->visited_capacity && !grow_visited(explorer))
+        return false;
+
+    u32 mask = explorer->visited_capacity - 1;
+
+    for (u32 i = hash & mask;; i = (i + 1) & mask)
+    {
+        if (explorer->visited[i] == hash)
+            return false;
+
+        if (explorer->visited[i] == 0)
+        {
+            explorer->visited[i] = hash;
+            explorer->stats.states++;
+            return true;
+        }
+    }
+}
+
+static bool grow_visited(Explorer *explorer)
+{
+    u32 capacity = explorer->visited_capacity > 0 ? explorer->visited_capacity * 2 : EXPLORER_VISITED_CAPACITY;
+    u64 *visited = calloc(capacity, sizeof(u64));
+
+    if (visited == NULL)
+        return false;
+
+    for (u32 i = 0; i < explorer->visited_capacity; i++)
+    {
+        u64 hash = explorer->visited[i];
+
+        if (hash == 0)
+            continue;
+
+        u32 slot = hash & (capacity - 1);
+
+        while (visited[slot] != 0)
+            slot = (slot + 1) & (capacity - 1);
+
+        visited[slot] = hash;
+    }
+
+    free(explorer->visited);
+    explorer->visited = visited;
+    explorer->visited_capacity = capacity;
+    return true;
+}
+
+static u16 mutate_keys(Explorer *explorer, u16 previous)
+{
+    u32 choice = next_random(explorer) % 8;
+
+    // mostly nothing or a single key, sometimes held from the last step or
+    // two at once.
+    if (choice < 2)
+        return 0;
+
+    if (choice < 3)
+        return previous;
+
+    if (choice < 7)
+        return 1 << (next_random(explorer) % 16);
+
+    return 1 << (next_random(explorer) % 16) | 1 << (next_random(explorer) % 16);
+}
+
+static u32 next_random(Explorer *explorer)
+{
+    u32 state = explorer->random_state;
+
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    explorer->random_state = state;
+
+    return state;
+}
+
+static void find_reachable_code(const Cpu *cpu, bool *reachable)
+{
+    u8 memory[CPU_MEMORY_SIZE];
+
+    for (u32 i = 0; i < CPU_MEMORY_SIZE; i++)
+        memory[i] = cpu_read_memory(cpu, i);
+
+    cpu_find_reachable_code(memory, reachable);
+}
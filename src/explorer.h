@@ -0,0 +1,106 @@
+#ifndef __EXPLORER_H__
+#define __EXPLORER_H__
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "types.h"
+#include "cpu.h"
+
+// every step holds one key mask for a few frames, as a player would.
+#define EXPLORER_FRAMES_PER_STEP 4
+#define EXPLORER_MAX_STEPS 4096
+#define EXPLORER_MUTATION_STEPS 16
+#define EXPLORER_MAX_ENTRIES 1024
+#define EXPLORER_COVERAGE_SCORE 64
+
+/**
+ * Why a run is worth keeping apart from its coverage.
+ *
+ *  - EXPLORER_STACK_OVERFLOW, EXPLORER_STACK_UNDERFLOW: the cpu faulted
+ *    on a CALL or a RET.
+ *  - EXPLORER_UNREACHED_CODE: the program counter got to an address the
+ *    static analysis of the rom (cpu_find_reachable_code) didn't reach,
+ *    usually data, or code only reached through Bnnn.
+ *
+ * Each kind is only reported once per address.
+ */
+typedef enum ExplorerFinding
+{
+    EXPLORER_NONE,
+    EXPLORER_STACK_OVERFLOW,
+    EXPLORER_STACK_UNDERFLOW,
+    EXPLORER_UNREACHED_CODE
+} ExplorerFinding;
+
+/**
+ * A state worth exploring from, with the inputs that reach it from reset
+ * and how much it found when it was added.
+ */
+typedef struct ExplorerEntry
+{
+    CpuState state;
+    u16 *inputs;
+    u32 input_count;
+    u32 score;
+    u32 picks;
+} ExplorerEntry;
+
+typedef struct ExplorerStats
+{
+    u64 runs;
+    u64 steps;
+    u64 instructions;
+    u64 states;
+    u32 covered;
+    u32 reachable;
+    u32 entries;
+    u32 findings;
+} ExplorerStats;
+
+/**
+ * Defines a coverage guided input explorer.
+ * Every run branches from a saved state, appends a few random key masks
+ * to the inputs that led there and runs them. The state hash (see
+ * cpu_get_state_hash) is checked after every step against the states
+ * already visited, and every executed address is marked in the coverage
+ * bitmap; runs that cover new code, or end in a new state, are saved as
+ * entries to branch from later.
+ * The inputs of the last run replay it from reset with explorer_replay,
+ * the rom's random numbers included.
+ */
+typedef struct Explorer
+{
+    Cpu cpu;
+    u16 cycles_per_frame;
+    u32 random_state;
+    bool reachable[CPU_MEMORY_SIZE];
+    u8 coverage[CPU_MEMORY_SIZE / 8];
+    u8 reported[EXPLORER_UNREACHED_CODE][CPU_MEMORY_SIZE / 8];
+    u64 *visited;
+    u32 visited_capacity;
+    ExplorerEntry *entries;
+    u32 entry_count;
+    u16 inputs[EXPLORER_MAX_STEPS];
+    u32 input_count;
+    u16 finding_address;
+    ExplorerStats stats;
+} Explorer;
+
+Explorer *explorer_create(const u8 *rom, u32 size, u16 cycles_per_frame, u32 seed);
+
+void explorer_free(Explorer *explorer);
+
+ExplorerFinding explorer_run(Explorer *explorer);
+
+const u16 *explorer_get_inputs(const Explorer *explorer, u32 *count);
+
+ExplorerFinding explorer_replay(Cpu *cpu, const u16 *inputs, u32 count, u16 cycles_per_frame);
+
+const char *explorer_get_finding_name(ExplorerFinding finding);
+
+bool explorer_save_inputs(const char *file_name, const u16 *inputs, u32 count, u16 cycles_per_frame);
+
+u16 *explorer_load_inputs(const char *file_name, u32 *count, u16 *cycles_per_frame);
+
+#endif /*__EXPLORER_H__*/
@@ -0,0 +1,225 @@
+#include "exporter.h"
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static Exporter *create_segment(const char *name);
+static bool take_over(ExportSegment *segment);
+static Exporter *map_segment(const char *name, i32 flags);
+
+Exporter *exporter_create(const char *name)
+{
+    char own_name[EXPORTER_NAME_SIZE];
+    Exporter *exporter = create_segment(name);
+
+    if (exporter == NULL && errno == EEXIST)
+    {
+        snprintf(own_name, sizeof(own_name), "%s.%d", name, (i32)getpid());
+        exporter = create_segment(own_name);
+    }
+
+    if (exporter == NULL)
+        return NULL;
+
+    ExportSegment *segment = exporter->segment;
+
+    memset(segment->slots, 0, sizeof(segment->slots));
+    segment->version = EXPORT_VERSION;
+    segment->width = GPU_SCREEN_WIDTH;
+    segment->height = GPU_SCREEN_HEIGHT;
+    segment->latest = 0;
+    segment->keys = 0;
+    __atomic_store_n(&segment->writer, (i32)getpid(), __ATOMIC_RELAXED);
+    __atomic_store_n(&segment->magic, EXPORT_MAGIC, __ATOMIC_RELEASE);
+
+    exporter->owner = true;
+    return exporter;
+}
+
+Exporter *exporter_open(const char *name)
+{
+    Exporter *exporter = map_segment(name, O_RDWR);
+
+    if (exporter == NULL)
+        return NULL;
+
+    if (__atomic_load_n(&exporter->segment->magic, __ATOMIC_ACQUIRE) != EXPORT_MAGIC ||
+        exporter->segment->version != EXPORT_VERSION)
+    {
+        exporter_free(exporter);
+        return NULL;
+    }
+
+    return exporter;
+}
+
+void exporter_free(Exporter *exporter)
+{
+    if (exporter == NULL)
+        return;
+
+    munmap(exporter->segment, sizeof(ExportSegment));
+
+    if (exporter->owner)
+        shm_unlink(exporter->name);
+
+    free(exporter);
+}
+
+static Exporter *create_segment(const char *name)
+{
+    Exporter *exporter = map_segment(name, O_CREAT | O_EXCL | O_RDWR);
+
+    if (exporter != NULL || errno != EEXIST)
+        return exporter;
+
+    exporter = map_segment(name, O_RDWR);
+
+    if (exporter != NULL && take_over(exporter->segment))
+        return exporter;
+
+    // the name stays taken, whatever holds it.
+    exporter_free(exporter);
+    errno = EEXIST;
+    return NULL;
+}
+
+static bool take_over(ExportSegment *segment)
+{
+    i32 writer = __atomic_load_n(&segment->writer, __ATOMIC_ACQUIRE);
+
+    // a segment of another layout may not even be ours, it's left alone.
+    if (__atomic_load_n(&segment->magic, __ATOMIC_ACQUIRE) != EXPORT_MAGIC || segment->version != EXPORT_VERSION)
+        return false;
+
+    // a null signal only checks whether the writer still exists.
+    if (writer > 0 && (kill(writer, 0) == 0 || errno != ESRCH))
+        return false;
+
+    // two emulators may find the same stale segment, only one gets it.
+    return __atomic_compare_exchange_n(&segment->writer, &writer, (i32)getpid(), false, __ATOMIC_ACQ_REL,
+                                       __ATOMIC_ACQUIRE);
+}
+
+static Exporter *map_segment(const char *name, i32 flags)
+{
+    if (strlen(name) >= EXPORTER_NAME_SIZE)
+    {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+
+    i32 file = shm_open(name, flags, 0600);
+
+    if (file < 0)
+        return NULL;
+
+    // readers check the size too, a segment of another layout is refused.
+    struct stat status;
+    bool sized = (flags & O_CREAT) ? ftruncate(file, sizeof(ExportSegment)) == 0
+                                   : fstat(file, &status) == 0 && (u64)status.st_size >= sizeof(ExportSegment);
+    void *segment = sized ? mmap(NULL, sizeof(ExportSegment), PROT_READ | PROT_WRITE, MAP_SHARED, file, 0) : MAP_FAILED;
+
+    close(file);
+
+    if (segment == MAP_FAILED)
+        return NULL;
+
+    Exporter *exporter = calloc(1, sizeof(Exporter));
+
+    if (exporter == NULL)
+    {
+        munmap(segment, sizeof(ExportSegment));
+        return NULL;
+    }
+
+    exporter->segment = segment;
+    memcpy(exporter->name, name, strlen(name) + 1);
+    return exporter;
+}
+
+#else
+
+Exporter *exporter_create(const char *name)
+{
+    (void)name;
+    return NULL;
+}
+
+Exporter *exporter_open(const char *name)
+{
+    (void)name;
+    return NULL;
+}
+
+void exporter_free(Exporter *exporter)
+{
+    (void)exporter;
+}
+
+#endif
+
+void exporter_publish(Exporter *exporter, const Cpu *cpu)
+{
+    ExportSegment *segment = exporter->segment;
+    u32 index = (segment->latest + 1) % EXPORT_SLOTS;
+    ExportSlot *slot = &segment->slots[index];
+    u32 sequence = slot->sequence;
+
+    // the slot written is never the latest one, so readers of the latest
+    // frame are only disturbed if they take longer than a frame.
+    __atomic_store_n(&slot->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    slot->program_counter = cpu->program_counter;
+    slot->index_register = cpu->index_register;
+    slot->frame = ++exporter->frame;
+    memcpy(slot->value_registers, cpu->value_registers, sizeof(slot->value_registers));
+    slot->delay_timer = cpu->delay_timer;
+    slot->sound_timer = cpu->sound_timer;
+    slot->stack_pointer = cpu->stack_pointer;
+    slot->fault = cpu->fault;
+    memcpy(slot->framebuffer, cpu_get_gpu(cpu)->memory, sizeof(slot->framebuffer));
+
+    __atomic_store_n(&slot->sequence, sequence + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&segment->latest, index, __ATOMIC_RELEASE);
+}
+
+u16 exporter_get_keys(const Exporter *exporter)
+{
+    return __atomic_load_n(&exporter->segment->keys, __ATOMIC_RELAXED);
+}
+
+void exporter_send_keys(Exporter *exporter, u16 keys)
+{
+    __atomic_store_n(&exporter->segment->keys, keys, __ATOMIC_RELAXED);
+}
+
+const ExportSlot *exporter_begin_read(const Exporter *exporter, u32 *sequence)
+{
+    const ExportSegment *segment = exporter->segment;
+
+    // a slot is only odd if the writer lapped the reader between loading
+    // latest and the sequence, loading latest again finds the newer one.
+    while (true)
+    {
+        const ExportSlot *slot = &segment->slots[__atomic_load_n(&segment->latest, __ATOMIC_ACQUIRE) % EXPORT_SLOTS];
+        *sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+
+        if ((*sequence & 1) == 0)
+            return slot;
+    }
+}
+
+bool exporter_end_read(const ExportSlot *slot, u32 sequence)
+{
+    // anything read in between is only valid if the slot wasn't touched.
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == sequence;
+}
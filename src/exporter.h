@@ -0,0 +1,95 @@
+#ifndef __EXPORTER_H__
+#define __EXPORTER_H__
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "types.h"
+#include "cpu.h"
+
+#define EXPORT_MAGIC 0x4D533843
+#define EXPORT_VERSION 2
+#define EXPORT_SLOTS 2
+#define EXPORTER_NAME_SIZE 64
+
+/**
+ * A frame as published in the shared segment: the framebuffer, one byte
+ * per pixel as the gpu holds it, and the registers it was drawn with.
+ * The header fills one 64 byte line, the framebuffer starts on the next.
+ *
+ * The sequence is odd while the slot is being written and moves by two
+ * on every frame written to it, see exporter_begin_read.
+ */
+typedef struct ExportSlot
+{
+    u32 sequence;
+    u16 program_counter;
+    u16 index_register;
+    u64 frame;
+    u8 value_registers[16];
+    u8 delay_timer;
+    u8 sound_timer;
+    u8 stack_pointer;
+    u8 fault;
+    u8 reserved[28];
+    u8 framebuffer[GPU_SCREEN_WIDTH * GPU_SCREEN_HEIGHT];
+} ExportSlot;
+
+/**
+ * The layout of the shared memory segment, the same for every process
+ * mapping it. The emulator writes the slots and latest, readers write the
+ * keys, which the emulator ors with its own keyboard every frame. The
+ * writer is the pid of the emulator publishing to it.
+ */
+typedef struct ExportSegment
+{
+    u32 magic;
+    u16 version;
+    u8 width;
+    u8 height;
+    u32 latest;
+    i32 writer;
+    u16 keys;
+    u8 reserved[46];
+    ExportSlot slots[EXPORT_SLOTS];
+} ExportSegment;
+
+/**
+ * Defines a frame exporter.
+ * Publishes every frame of a cpu to a POSIX shared memory segment, so
+ * other processes can map it and read frames in place, with no copy and
+ * no system call per frame. Frames are written to two slots in turns and
+ * each slot is guarded by a seqlock: a reader gets the latest complete
+ * frame and a whole frame period to read it before its slot is reused.
+ * The same handle is used by readers, see exporter_open.
+ * The segment is created exclusively. A name already taken by a running
+ * emulator is left to it and the segment is created as <name>.<pid>
+ * instead, see name; one left behind by an emulator that's gone is
+ * taken over, so readers still mapping it see the new frames.
+ * Not available on Windows, where exporter_create returns NULL.
+ */
+typedef struct Exporter
+{
+    ExportSegment *segment;
+    char name[EXPORTER_NAME_SIZE];
+    bool owner;
+    u64 frame;
+} Exporter;
+
+Exporter *exporter_create(const char *name);
+
+Exporter *exporter_open(const char *name);
+
+void exporter_free(Exporter *exporter);
+
+void exporter_publish(Exporter *exporter, const Cpu *cpu);
+
+u16 exporter_get_keys(const Exporter *exporter);
+
+void exporter_send_keys(Exporter *exporter, u16 keys);
+
+const ExportSlot *exporter_begin_read(const Exporter *exporter, u32 *sequence);
+
+bool exporter_end_read(const ExportSlot *slot, u32 sequence);
+
+#endif /*__EXPORTER_H__*/
@@ -0,0 +1,172 @@
+#include "governor.h"
+
+// the usual delay timer wait: Fx07, 3x00, then a jump back to Fx07.
+#define GOVERNOR_WAIT_LOOP_SIZE 3
+#define GOVERNOR_MARGIN 8
+
+static void update_budget(Governor *governor, const Cpu *cpu, u32 polls, u32 key_waits);
+static bool is_idle(const Cpu *cpu);
+static inline u16 read_op(const Cpu *cpu, u16 address);
+
+void governor_init(Governor *governor, u16 nominal_cycles, u16 min_cycles, u16 max_cycles)
+{
+    memset(governor, 0, sizeof(Governor));
+
+    governor->min_cycles = min_cycles < 1 ? 1 : min_cycles;
+    governor->max_cycles = max_cycles < governor->min_cycles ? governor->min_cycles : max_cycles;
+    governor->nominal_cycles = nominal_cycles < governor->min_cycles   ? governor->min_cycles
+                               : nominal_cycles > governor->max_cycles ? governor->max_cycles
+                                                                       : nominal_cycles;
+    governor->cycles = governor->nominal_cycles;
+    governor->decision = GOVERNOR_NOMINAL;
+    governor->frames_since_timer_sync = GOVERNOR_STARVED_FRAMES;
+}
+
+u32 governor_run_frame(Governor *governor, Cpu *cpu)
+{
+    const CpuStats before = cpu->stats;
+    const f64 start = clock_get_seconds();
+    CpuStopReason reason = CPU_STOP_CYCLES;
+    u32 executed = 0;
+
+    // draws and sound starts don't end the frame. Key and timer waits do,
+    // the rest of the budget would only spin until the next frame.
+    while (executed < governor->cycles)
+    {
+        executed += cpu_run(cpu, governor->cycles - executed, &reason);
+
+        if (reason == CPU_STOP_KEY_WAIT || reason == CPU_STOP_TIMER_WAIT ||
+            reason == CPU_STOP_FAULT || reason == CPU_STOP_BREAKPOINT)
+            break;
+    }
+
+    governor->frame_time = clock_get_seconds() - start;
+    governor->executed = executed;
+
+    if (executed > 0)
+        governor->instruction_time += (governor->frame_time / executed - governor->instruction_time) / GOVERNOR_SMOOTHING;
+
+    governor->draw_rate += ((f32)(cpu->stats.draws - before.draws) - governor->draw_rate) / GOVERNOR_SMOOTHING;
+
+    update_budget(governor, cpu, cpu->stats.timer_polls - before.timer_polls, cpu->stats.key_waits - before.key_waits);
+
+    return executed;
+}
+
+const char *governor_get_decision_name(GovernorDecision decision)
+{
+    switch (decision)
+    {
+    case GOVERNOR_NOMINAL:
+        return "NOMINAL";
+    case GOVERNOR_TIMER_SYNC:
+        return "TIMER SYNC";
+    case GOVERNOR_STARVED:
+        return "STARVED";
+    case GOVERNOR_KEY_WAIT:
+        return "KEY WAIT";
+    case GOVERNOR_IDLE:
+        return "IDLE";
+    case GOVERNOR_HOST_LIMITED:
+        return "HOST LIMITED";
+    }
+
+    return "UNKNOWN";
+}
+
+static void update_budget(Governor *governor, const Cpu *cpu, u32 polls, u32 key_waits)
+{
+    const bool timer_wait = cpu_is_waiting_on_timer(cpu);
+    u32 cycles = governor->cycles;
+
+    governor->timer_wait_rate += ((timer_wait ? 1.0f : 0.0f) - governor->timer_wait_rate) / GOVERNOR_SMOOTHING;
+    governor->key_wait_rate += ((key_waits > 0 ? 1.0f : 0.0f) - governor->key_wait_rate) / GOVERNOR_SMOOTHING;
+
+    // the instructions the frame needed before spinning on the timer: every
+    // poll but the first one is a turn of the wait loop.
+    governor->work = governor->executed;
+
+    if (timer_wait && polls > 1)
+    {
+        u32 spin = (polls - 1) * GOVERNOR_WAIT_LOOP_SIZE;
+        governor->work = spin < governor->executed ? governor->executed - spin : 1;
+    }
+
+    // a frame that did some work and then waited is what a rom synced to
+    // the timer looks like; a frame that only spun is a pause, and a long
+    // pause doesn't mean the rom will wait again once it's over.
+    if (timer_wait && governor->work > GOVERNOR_WAIT_LOOP_SIZE * 2)
+        governor->frames_since_timer_sync = 0;
+    else if (governor->frames_since_timer_sync < GOVERNOR_STARVED_FRAMES)
+        governor->frames_since_timer_sync++;
+
+    // the budget follows the heaviest frame of the last second or two, so a
+    // few light frames (a pause on the timer) don't starve the next heavy one.
+    if (governor->frames_since_timer_sync < GOVERNOR_STARVED_FRAMES && governor->work > governor->window_peak_work)
+        governor->window_peak_work = governor->work;
+
+    if (++governor->window_frames >= GOVERNOR_WINDOW)
+    {
+        governor->peak_work = governor->window_peak_work;
+        governor->window_peak_work = 0;
+        governor->window_frames = 0;
+    }
+
+    if (key_waits > 0)
+    {
+        governor->decision = GOVERNOR_KEY_WAIT;
+    }
+    else if (is_idle(cpu))
+    {
+        governor->decision = GOVERNOR_IDLE;
+        cycles = governor->min_cycles;
+    }
+    else if (timer_wait)
+    {
+        u32 work = governor->peak_work > governor->window_peak_work ? governor->peak_work : governor->window_peak_work;
+
+        governor->decision = GOVERNOR_TIMER_SYNC;
+        cycles = work + work / 4 + GOVERNOR_MARGIN;
+    }
+    else if (governor->frames_since_timer_sync < GOVERNOR_STARVED_FRAMES)
+    {
+        governor->decision = GOVERNOR_STARVED;
+        cycles = cycles + cycles / 2 + 1;
+    }
+    else
+    {
+        governor->decision = GOVERNOR_NOMINAL;
+        cycles = governor->nominal_cycles;
+    }
+
+    // a slow host would otherwise spend more than a frame emulating one.
+    if (governor->instruction_time > 0)
+    {
+        f64 limit = GOVERNOR_HOST_SHARE * GOVERNOR_FRAME_TIME / governor->instruction_time;
+
+        if (cycles > limit)
+        {
+            cycles = (u32)limit;
+            governor->decision = GOVERNOR_HOST_LIMITED;
+        }
+    }
+
+    if (cycles < governor->min_cycles)
+        cycles = governor->min_cycles;
+
+    if (cycles > governor->max_cycles)
+        cycles = governor->max_cycles;
+
+    governor->cycles = cycles;
+}
+
+static bool is_idle(const Cpu *cpu)
+{
+    // a jump to itself, the usual way a rom stops.
+    return read_op(cpu, cpu->program_counter) == (0x1000 | cpu->program_counter);
+}
+
+static inline u16 read_op(const Cpu *cpu, u16 address)
+{
+    return (memory_read(&cpu->memory, address) << 8) | memory_read(&cpu->memory, address + 1);
+}
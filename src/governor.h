@@ -0,0 +1,73 @@
+#ifndef __GOVERNOR_H__
+#define __GOVERNOR_H__
+
+#include "types.h"
+#include "clock.h"
+#include "cpu.h"
+
+#define GOVERNOR_FRAME_TIME (1.0 / 60)
+#define GOVERNOR_HOST_SHARE 0.5
+#define GOVERNOR_WINDOW 60
+#define GOVERNOR_STARVED_FRAMES 8
+#define GOVERNOR_SMOOTHING 16
+
+/**
+ * What the governor based the current budget on.
+ *
+ *  - GOVERNOR_NOMINAL: the rom runs free, its speed is the budget, so it
+ *    gets the cycles per frame it was started with.
+ *  - GOVERNOR_TIMER_SYNC: the rom waits on the delay timer, so it gets
+ *    just enough cycles to reach the wait every frame.
+ *  - GOVERNOR_STARVED: a rom that was waiting on the delay timer didn't
+ *    reach the wait, so the budget grows until it does again.
+ *  - GOVERNOR_KEY_WAIT: the rom is blocked on Fx0A, frames end at the
+ *    wait and the budget is kept for when a key is pressed.
+ *  - GOVERNOR_IDLE: the rom jumps to itself forever, it gets the minimum.
+ *  - GOVERNOR_HOST_LIMITED: the budget was capped so emulating a frame
+ *    takes at most a share of the host frame time.
+ */
+typedef enum GovernorDecision
+{
+    GOVERNOR_NOMINAL,
+    GOVERNOR_TIMER_SYNC,
+    GOVERNOR_STARVED,
+    GOVERNOR_KEY_WAIT,
+    GOVERNOR_IDLE,
+    GOVERNOR_HOST_LIMITED
+} GovernorDecision;
+
+/**
+ * Defines an adaptive cycles per frame governor.
+ * Runs one emulated frame at a time and tunes the budget of the next one,
+ * within the rom's bounds, from what the rom did in the last ones: how
+ * many instructions it needed before waiting on the delay timer, whether
+ * it waited on a key, and how long the host took per instruction.
+ * The rates are moving averages over the last frames, for the overlay.
+ */
+typedef struct Governor
+{
+    u16 nominal_cycles;
+    u16 min_cycles;
+    u16 max_cycles;
+    u16 cycles;
+    GovernorDecision decision;
+    u32 executed;
+    u32 work;
+    u32 peak_work;
+    u32 window_peak_work;
+    u32 window_frames;
+    u32 frames_since_timer_sync;
+    f32 timer_wait_rate;
+    f32 key_wait_rate;
+    f32 draw_rate;
+    f64 instruction_time;
+    f64 frame_time;
+} Governor;
+
+void governor_init(Governor *governor, u16 nominal_cycles, u16 min_cycles, u16 max_cycles);
+
+u32 governor_run_frame(Governor *governor, Cpu *cpu);
+
+const char *governor_get_decision_name(GovernorDecision decision);
+
+#endif /*__GOVERNOR_H__*/
@@ -1,6 +1,12 @@
 #include "gpu.h"
 
-u8 gpu_get_pixel(Gpu *gpu, u8 x, u8 y)
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define GPU_PACK_MAGIC 0x0102040810204080ULL
+#else
+#define GPU_PACK_MAGIC 0x8040201008040201ULL
+#endif
+
+u8 gpu_get_pixel(const Gpu *gpu, u8 x, u8 y)
 {
     return gpu->memory[y * GPU_SCREEN_WIDTH + x];
 }
@@ -15,25 +21,84 @@ void gpu_reset(Gpu *gpu)
     memset(gpu->memory, (u8)0, sizeof(gpu->memory));
 }
 
-bool gpu_draw_sprite(Gpu *gpu, u8 x, u8 y, const u8 *memory, u16 index_from, u8 length)
+bool gpu_draw_sprite(Gpu *gpu, u8 x, u8 y, const u8 *sprite, u8 length)
+{
+    u64 rows[16];
+
+    gpu_expand_sprite(sprite, length, rows);
+    return gpu_draw_expanded_sprite(gpu, x, y, rows, length);
+}
+
+void gpu_expand_sprite(const u8 *sprite, u8 length, u64 *rows)
+{
+    // each row becomes the 8 framebuffer bytes it xors, one per pixel, in
+    // memory order, so drawing it takes no per pixel shifts.
+    for (u8 row = 0; row < length; row++)
+    {
+        u8 pixels[GPU_SPRITE_WIDTH];
+
+        for (u8 bit = 0; bit < GPU_SPRITE_WIDTH; bit++)
+            pixels[bit] = (sprite[row] >> (7 - bit)) & 0x01;
+
+        memcpy(&rows[row], pixels, sizeof(pixels));
+    }
+}
+
+bool gpu_draw_expanded_sprite(Gpu *gpu, u8 x, u8 y, const u64 *rows, u8 length)
 {
-    bool collision = false;
-    for (u16 rows = 0; rows < length; rows++)
+    u64 collision = 0;
+    u8 px = x % GPU_SCREEN_WIDTH;
+
+    for (u8 row = 0; row < length; row++)
     {
-        u8 sprite = memory[index_from + rows];
+        u8 *line = &gpu->memory[((y + row) % GPU_SCREEN_HEIGHT) * GPU_SCREEN_WIDTH];
 
-        for (u8 bit = 0; bit < 8; bit++)
+        // the whole row fits before the right edge: a single 8 byte xor.
+        if (px <= GPU_SCREEN_WIDTH - GPU_SPRITE_WIDTH)
         {
-            u8 new_value = (sprite >> (7 - bit)) & 0x01;
+            u64 pixels;
 
-            u8 px = (x + bit) % GPU_SCREEN_WIDTH;
-            u8 py = (y + rows) % GPU_SCREEN_HEIGHT;
-            u8 old_value = gpu_get_pixel(gpu, px, py);
+            memcpy(&pixels, &line[px], sizeof(pixels));
+            collision |= pixels & rows[row];
+            pixels ^= rows[row];
+            memcpy(&line[px], &pixels, sizeof(pixels));
+            continue;
+        }
 
-            collision = collision || (old_value == 1 && new_value == 1);
-            gpu_set_pixel(gpu, px, py, old_value ^ new_value);
+        // the row wraps around to the left edge.
+        u8 pixels[GPU_SPRITE_WIDTH];
+        memcpy(pixels, &rows[row], sizeof(pixels));
+
+        for (u8 bit = 0; bit < GPU_SPRITE_WIDTH; bit++)
+        {
+            u8 *pixel = &line[(px + bit) % GPU_SCREEN_WIDTH];
+
+            collision |= *pixel & pixels[bit];
+            *pixel ^= pixels[bit];
         }
     }
 
-    return collision;
-}
\ No newline at end of file
+    return collision != 0;
+}
+
+void gpu_pack_frame(const Gpu *gpu, u8 *frame)
+{
+    // one bit per pixel, rows top to bottom and the leftmost pixel in the
+    // highest bit: the same layout as a binary pbm.
+    for (u16 i = 0; i < GPU_PACKED_FRAME_SIZE; i++)
+    {
+        u64 pixels;
+        memcpy(&pixels, &gpu->memory[i * 8], sizeof(pixels));
+
+        // gathers the low bit of the 8 pixel bytes, first pixel highest,
+        // into the top byte of the product.
+        frame[i] = (pixels * GPU_PACK_MAGIC) >> 56;
+    }
+}
+
+void gpu_unpack_frame(Gpu *gpu, const u8 *frame)
+{
+    // the layout of gpu_pack_frame, back to one byte per pixel.
+    for (u16 i = 0; i < GPU_SCREEN_WIDTH * GPU_SCREEN_HEIGHT; i++)
+        gpu->memory[i] = (frame[i / 8] >> (7 - i % 8)) & 0x01;
+}
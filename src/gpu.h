@@ -7,6 +7,8 @@
 
 #define GPU_SCREEN_WIDTH 64
 #define GPU_SCREEN_HEIGHT 32
+#define GPU_SPRITE_WIDTH 8
+#define GPU_PACKED_FRAME_SIZE (GPU_SCREEN_WIDTH * GPU_SCREEN_HEIGHT / 8)
 
 /**
  * Defines a gpu device.
@@ -17,12 +19,20 @@ typedef struct Gpu
     u8 memory[GPU_SCREEN_WIDTH * GPU_SCREEN_HEIGHT];
 } Gpu;
 
-u8 gpu_get_pixel(Gpu *gpu, u8 x, u8 y);
+u8 gpu_get_pixel(const Gpu *gpu, u8 x, u8 y);
 
 void gpu_set_pixel(Gpu *gpu, u8 x, u8 y, u8 value);
 
 void gpu_reset(Gpu *gpu);
 
-bool gpu_draw_sprite(Gpu *gpu, u8 x, u8 y, const u8 *memory, u16 index_from, u8 length);
+bool gpu_draw_sprite(Gpu *gpu, u8 x, u8 y, const u8 *sprite, u8 length);
+
+void gpu_expand_sprite(const u8 *sprite, u8 length, u64 *rows);
+
+bool gpu_draw_expanded_sprite(Gpu *gpu, u8 x, u8 y, const u64 *rows, u8 length);
+
+void gpu_pack_frame(const Gpu *gpu, u8 *frame);
+
+void gpu_unpack_frame(Gpu *gpu, const u8 *frame);
 
 #endif /*__GPU_H__*/
\ No newline at end of file
@@ -12,7 +12,8 @@ bool keyboard_is_any_key_pressed(const Keyboard *keyboard)
 
 bool keyboard_is_key_pressed(const Keyboard *keyboard, u8 key)
 {
-    return ((keyboard->memory >> key) & 0x01) != 0;
+    // only the low nibble names a key, larger values wrap like addresses.
+    return ((keyboard->memory >> (key & 0x0F)) & 0x01) != 0;
 }
 
 i8 keyboard_get_key_pressed_index(const Keyboard *keyboard)
@@ -0,0 +1,183 @@
+#include "latency.h"
+
+static void start_transition(Latency *latency, const Cpu *cpu, f64 time, f64 emulated_time);
+static void record(Latency *latency, LatencyStage stage, f64 seconds);
+static u32 get_bucket(u64 value);
+static f64 get_bucket_middle(u32 bucket);
+
+void latency_init(Latency *latency)
+{
+    memset(latency, 0, sizeof(Latency));
+}
+
+void latency_key_event(Latency *latency, const Cpu *cpu, f64 time, f64 emulated_time)
+{
+    if (cpu->keyboard.memory == latency->keys)
+        return;
+
+    latency->keys = cpu->keyboard.memory;
+    latency->transitions++;
+
+    // a transition is followed to the end, the ones arriving meanwhile
+    // would measure the same frames again.
+    if (latency->state != LATENCY_IDLE && emulated_time - latency->input_emulated_time < LATENCY_TIMEOUT)
+    {
+        latency->skipped++;
+        return;
+    }
+
+    if (latency->state != LATENCY_IDLE)
+        latency->dropped++;
+
+    start_transition(latency, cpu, time, emulated_time);
+}
+
+void latency_begin_frame(Latency *latency, f64 time)
+{
+    if (latency->state != LATENCY_QUEUED)
+        return;
+
+    record(latency, LATENCY_INPUT, time - latency->input_time);
+    latency->frame_time = time;
+    latency->state = LATENCY_EMULATING;
+}
+
+bool latency_check_draw(Latency *latency, const Cpu *cpu, f64 time, f64 emulated_time)
+{
+    if (latency->state != LATENCY_EMULATING)
+        return false;
+
+    if (emulated_time - latency->input_emulated_time >= LATENCY_TIMEOUT)
+    {
+        latency->dropped++;
+        latency->state = LATENCY_IDLE;
+        return false;
+    }
+
+    if (memcmp(latency->framebuffer, cpu_get_gpu(cpu)->memory, sizeof(latency->framebuffer)) == 0)
+        return false;
+
+    record(latency, LATENCY_EMULATION, time - latency->frame_time);
+    record(latency, LATENCY_EMULATED, emulated_time - latency->input_emulated_time);
+    latency->draw_time = time;
+    latency->state = LATENCY_DRAWN;
+    return true;
+}
+
+void latency_present(Latency *latency, f64 time)
+{
+    if (latency->state != LATENCY_DRAWN)
+        return;
+
+    record(latency, LATENCY_PRESENT, time - latency->draw_time);
+    record(latency, LATENCY_TOTAL, time - latency->input_time);
+    latency->state = LATENCY_IDLE;
+}
+
+f64 latency_get_percentile(const LatencyHistogram *histogram, f64 percentile)
+{
+    u64 target = (u64)(percentile * histogram->count + 0.5);
+    u64 count = 0;
+
+    if (histogram->count == 0)
+        return 0;
+
+    target = target < 1 ? 1 : target;
+
+    for (u32 i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        count += histogram->counts[i];
+
+        // the middle of a bucket can be past the largest value in it.
+        if (count >= target)
+            return get_bucket_middle(i) < histogram->max ? get_bucket_middle(i) : histogram->max;
+    }
+
+    return histogram->max;
+}
+
+const char *latency_get_stage_name(LatencyStage stage)
+{
+    switch (stage)
+    {
+    case LATENCY_INPUT:
+        return "input";
+    case LATENCY_EMULATION:
+        return "emulation";
+    case LATENCY_PRESENT:
+        return "present";
+    case LATENCY_TOTAL:
+        return "total";
+    case LATENCY_EMULATED:
+        return "emulated";
+    default:
+        return "?";
+    }
+}
+
+void latency_print(const Latency *latency, FILE *file)
+{
+    fprintf(file, "%llu transitions, %llu skipped while following one, %llu never drawn\n",
+            (unsigned long long)latency->transitions, (unsigned long long)latency->skipped,
+            (unsigned long long)latency->dropped);
+
+    for (u8 i = 0; i < LATENCY_STAGES; i++)
+    {
+        const LatencyHistogram *histogram = &latency->histograms[i];
+
+        fprintf(file, "%-10s p50 %8.3fms  p99 %8.3fms  max %8.3fms  mean %8.3fms  (%llu)\n",
+                latency_get_stage_name(i), latency_get_percentile(histogram, 0.5) * 1000,
+                latency_get_percentile(histogram, 0.99) * 1000, histogram->max * 1000,
+                histogram->count > 0 ? histogram->total / histogram->count * 1000 : 0,
+                (unsigned long long)histogram->count);
+    }
+}
+
+static void start_transition(Latency *latency, const Cpu *cpu, f64 time, f64 emulated_time)
+{
+    // the framebuffer as it was when the key changed, any difference from
+    // it afterwards is the rom's answer.
+    memcpy(latency->framebuffer, cpu_get_gpu(cpu)->memory, sizeof(latency->framebuffer));
+    latency->input_time = time;
+    latency->input_emulated_time = emulated_time;
+    latency->state = LATENCY_QUEUED;
+}
+
+static void record(Latency *latency, LatencyStage stage, f64 seconds)
+{
+    LatencyHistogram *histogram = &latency->histograms[stage];
+
+    seconds = seconds < 0 ? 0 : seconds;
+    histogram->counts[get_bucket((u64)(seconds * 1e6))]++;
+    histogram->count++;
+    histogram->total += seconds;
+    histogram->max = seconds > histogram->max ? seconds : histogram->max;
+}
+
+static u32 get_bucket(u64 value)
+{
+    u32 exponent = 0;
+
+    if (value < LATENCY_SUB_BUCKETS)
+        return value;
+
+    while (value >> (exponent + 1))
+        exponent++;
+
+    // the power of two picks a group, the next 3 bits the bucket in it.
+    u32 bucket = (exponent - 2) * LATENCY_SUB_BUCKETS + ((value >> (exponent - 3)) & (LATENCY_SUB_BUCKETS - 1));
+
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+static f64 get_bucket_middle(u32 bucket)
+{
+    if (bucket < LATENCY_SUB_BUCKETS)
+        return (bucket + 0.5) / 1e6;
+
+    u32 exponent = bucket / LATENCY_SUB_BUCKETS + 2;
+    u64 width = 1ull << (exponent - 3);
+    u64 lower = (LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS) * width;
+
+    return (lower + width / 2.0) / 1e6;
+}
@@ -0,0 +1,97 @@
+#ifndef __LATENCY_H__
+#define __LATENCY_H__
+
+#include <stdio.h>
+#include <string.h>
+#include "types.h"
+#include "cpu.h"
+
+// values are in microseconds, with 8 buckets per power of two up to 2^26.
+#define LATENCY_SUB_BUCKETS 8
+#define LATENCY_BUCKETS 200
+#define LATENCY_TIMEOUT 2.0
+
+/**
+ * The stages a key transition goes through before it's seen.
+ *
+ *  - LATENCY_INPUT: from the transition reaching the keyboard to the start
+ *    of the first emulated frame that sees it.
+ *  - LATENCY_EMULATION: from that frame's start to the first draw that
+ *    changed the framebuffer, in host time.
+ *  - LATENCY_PRESENT: from that draw to the frame being presented.
+ *  - LATENCY_TOTAL: from the transition to the present.
+ *  - LATENCY_EMULATED: from the transition to the draw, in emulated time.
+ */
+typedef enum LatencyStage
+{
+    LATENCY_INPUT,
+    LATENCY_EMULATION,
+    LATENCY_PRESENT,
+    LATENCY_TOTAL,
+    LATENCY_EMULATED,
+    LATENCY_STAGES
+} LatencyStage;
+
+typedef enum LatencyState
+{
+    LATENCY_IDLE,
+    LATENCY_QUEUED,
+    LATENCY_EMULATING,
+    LATENCY_DRAWN
+} LatencyState;
+
+/**
+ * A log scale histogram, good to about 6% at any scale.
+ */
+typedef struct LatencyHistogram
+{
+    u32 counts[LATENCY_BUCKETS];
+    u64 count;
+    f64 total;
+    f64 max;
+} LatencyHistogram;
+
+/**
+ * Defines an input to pixel latency tracker.
+ * Follows one key transition at a time from the keyboard, through the
+ * emulated frames, to the first draw that changed the framebuffer and to
+ * the present that showed it; transitions arriving meanwhile are only
+ * counted. The framebuffer is compared with the one at the transition
+ * whenever the caller checks it: once per frame gives frame precision,
+ * after every draw stop gives instruction precision.
+ * A transition not drawn within LATENCY_TIMEOUT seconds of emulated time
+ * is dropped, so a host running faster or slower than the rom drops the
+ * same transitions.
+ */
+typedef struct Latency
+{
+    LatencyHistogram histograms[LATENCY_STAGES];
+    LatencyState state;
+    u16 keys;
+    u64 transitions;
+    u64 skipped;
+    u64 dropped;
+    f64 input_time;
+    f64 input_emulated_time;
+    f64 frame_time;
+    f64 draw_time;
+    u8 framebuffer[GPU_SCREEN_WIDTH * GPU_SCREEN_HEIGHT];
+} Latency;
+
+void latency_init(Latency *latency);
+
+void latency_key_event(Latency *latency, const Cpu *cpu, f64 time, f64 emulated_time);
+
+void latency_begin_frame(Latency *latency, f64 time);
+
+bool latency_check_draw(Latency *latency, const Cpu *cpu, f64 time, f64 emulated_time);
+
+void latency_present(Latency *latency, f64 time);
+
+f64 latency_get_percentile(const LatencyHistogram *histogram, f64 percentile);
+
+const char *latency_get_stage_name(LatencyStage stage);
+
+void latency_print(const Latency *latency, FILE *file);
+
+#endif /*__LATENCY_H__*/
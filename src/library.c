@@ -0,0 +1,409 @@
+#include "library.h"
+#include "cpu.h"
+#include <dirent.h>
+#include <sys/stat.h>
+
+#define LIBRARY_CHIP8_CYCLES 10
+#define LIBRARY_SUPER_CHIP_CYCLES 30
+#define LIBRARY_XO_CHIP_CYCLES 200
+
+// opcode families the quirk suggestions depend on.
+#define LIBRARY_USES_LOGIC 0x01
+#define LIBRARY_USES_MEMORY 0x02
+#define LIBRARY_USES_DRAW 0x04
+#define LIBRARY_USES_SHIFT 0x08
+#define LIBRARY_USES_JUMP 0x10
+
+/**
+ * Header of the index file, followed by count entries.
+ * The entry size guards against indexes written by a different build.
+ */
+typedef struct LibraryIndexHeader
+{
+    char magic[4];
+    u32 version;
+    u32 entry_size;
+    u32 count;
+} LibraryIndexHeader;
+
+static void abort_load(Library *library, DIR *dir, LibraryEntry *cached, u8 *rom);
+static u32 read_index(const char *file_name, LibraryEntry **entries);
+static void write_index(const char *file_name, const LibraryEntry *entries, u32 count);
+static bool read_rom(const char *file_name, u8 *rom, u32 *size);
+static const LibraryEntry *find_entry_by_name(const LibraryEntry *entries, u32 count, const char *name);
+static const LibraryEntry *find_entry_by_hash(const LibraryEntry *entries, u32 count, u64 hash);
+static u8 detect_platform(const u8 *memory, const bool *reachable, u32 size, u8 *uses);
+static u8 suggest_quirks(u8 platform, u8 uses);
+static void render_thumbnail(const u8 *rom, u32 size, u16 cycles_per_frame, u8 *thumbnail);
+static i32 compare_entries(const void *a, const void *b);
+
+bool library_load(Library *library, const char *directory)
+{
+    char index_name[LIBRARY_PATH_SIZE];
+    char path[LIBRARY_PATH_SIZE];
+    LibraryEntry *cached = NULL;
+    u32 capacity = 64;
+    DIR *dir = opendir(directory);
+
+    memset(library, 0, sizeof(Library));
+
+    if (dir == NULL)
+        return false;
+
+    snprintf(library->directory, sizeof(library->directory), "%s", directory);
+    snprintf(index_name, sizeof(index_name), "%s/%s", directory, LIBRARY_INDEX_FILE);
+
+    u32 cached_count = read_index(index_name, &cached);
+    u8 *rom = malloc(LIBRARY_MAX_ROM_SIZE);
+    library->entries = malloc(capacity * sizeof(LibraryEntry));
+
+    if (rom == NULL || library->entries == NULL)
+    {
+        abort_load(library, dir, cached, rom);
+        return false;
+    }
+
+    for (struct dirent *file = readdir(dir); file != NULL; file = readdir(dir))
+    {
+        struct stat info;
+
+        // hidden files, the index among them, aren't roms.
+        if (file->d_name[0] == '.' || strlen(file->d_name) >= LIBRARY_NAME_SIZE)
+            continue;
+
+        snprintf(path, sizeof(path), "%s/%s", directory, file->d_name);
+
+        if (stat(path, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0 || info.st_size > LIBRARY_MAX_ROM_SIZE)
+            continue;
+
+        if (library->count == capacity)
+        {
+            // the entries so far are only freed if they can't grow.
+            LibraryEntry *entries = realloc(library->entries, capacity * 2 * sizeof(LibraryEntry));
+
+            if (entries == NULL)
+            {
+                abort_load(library, dir, cached, rom);
+                return false;
+            }
+
+            library->entries = entries;
+            capacity *= 2;
+        }
+
+        LibraryEntry *entry = &library->entries[library->count];
+        const LibraryEntry *known = find_entry_by_name(cached, cached_count, file->d_name);
+
+        // unchanged roms are taken from the index without reading them.
+        if (known != NULL && known->size == info.st_size && known->modified == (i64)info.st_mtime)
+        {
+            *entry = *known;
+            library->count++;
+            continue;
+        }
+
+        u32 size;
+
+        if (!read_rom(path, rom, &size))
+            continue;
+
+        // a renamed or touched rom keeps the metadata of its contents.
+        u64 hash = library_hash(rom, size);
+        known = find_entry_by_hash(cached, cached_count, hash);
+
+        if (known != NULL)
+            *entry = *known;
+        else
+            library_analyze_rom(rom, size, entry);
+
+        memcpy(entry->name, file->d_name, strlen(file->d_name) + 1);
+        entry->modified = info.st_mtime;
+        library->count++;
+        library->analyzed++;
+    }
+
+    closedir(dir);
+    free(rom);
+
+    qsort(library->entries, library->count, sizeof(LibraryEntry), compare_entries);
+
+    if (library->analyzed > 0 || library->count != cached_count)
+        write_index(index_name, library->entries, library->count);
+
+    free(cached);
+    return true;
+}
+
+void library_free(Library *library)
+{
+    free(library->entries);
+    library->entries = NULL;
+    library->count = 0;
+}
+
+void library_get_path(const Library *library, u32 index, char *path, u32 size)
+{
+    snprintf(path, size, "%s/%s", library->directory, library->entries[index].name);
+}
+
+const char *library_get_platform_name(u8 platform)
+{
+    switch (platform)
+    {
+    case LIBRARY_SUPER_CHIP:
+        return "SUPER-CHIP";
+    case LIBRARY_XO_CHIP:
+        return "XO-CHIP";
+    default:
+        return "CHIP-8";
+    }
+}
+
+u64 library_hash(const u8 *data, u32 size)
+{
+    // 64 bit FNV-1a.
+    u64 hash = 0xCBF29CE484222325ULL;
+
+    for (u32 i = 0; i < size; i++)
+        hash = (hash ^ data[i]) * 0x100000001B3ULL;
+
+    return hash;
+}
+
+void library_analyze_rom(const u8 *rom, u32 size, LibraryEntry *entry)
+{
+    u8 memory[CPU_MEMORY_SIZE] = {0};
+    bool reachable[CPU_MEMORY_SIZE];
+    u8 uses = 0;
+
+    memset(entry, 0, sizeof(LibraryEntry));
+    entry->hash = library_hash(rom, size);
+    entry->size = size;
+
+    // only the code reachable from the program start is scanned, so data
+    // that happens to look like an extended opcode doesn't count.
+    memcpy(&memory[CPU_PROGRAM_START], rom, size < CPU_MEMORY_SIZE - CPU_PROGRAM_START ? size : CPU_MEMORY_SIZE - CPU_PROGRAM_START);
+    cpu_find_reachable_code(memory, reachable);
+
+    entry->platform = detect_platform(memory, reachable, size, &uses);
+    entry->quirks = suggest_quirks(entry->platform, uses);
+
+    switch (entry->platform)
+    {
+    case LIBRARY_SUPER_CHIP:
+        entry->cycles_per_frame = LIBRARY_SUPER_CHIP_CYCLES;
+        break;
+    case LIBRARY_XO_CHIP:
+        entry->cycles_per_frame = LIBRARY_XO_CHIP_CYCLES;
+        break;
+    default:
+        entry->cycles_per_frame = LIBRARY_CHIP8_CYCLES;
+        break;
+    }
+
+    render_thumbnail(rom, size, entry->cycles_per_frame, entry->thumbnail);
+}
+
+static void abort_load(Library *library, DIR *dir, LibraryEntry *cached, u8 *rom)
+{
+    closedir(dir);
+    free(cached);
+    free(rom);
+    library_free(library);
+}
+
+static u32 read_index(const char *file_name, LibraryEntry **entries)
+{
+    LibraryIndexHeader header;
+    FILE *file = fopen(file_name, "rb");
+
+    *entries = NULL;
+
+    if (file == NULL)
+        return 0;
+
+    // anything unexpected, a partial write included, discards the index.
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, "C8LI", 4) != 0 ||
+        header.version != LIBRARY_INDEX_VERSION || header.entry_size != sizeof(LibraryEntry))
+    {
+        fclose(file);
+        return 0;
+    }
+
+    *entries = malloc((u64)header.count * sizeof(LibraryEntry) + 1);
+
+    if (*entries == NULL || fread(*entries, sizeof(LibraryEntry), header.count, file) != header.count)
+        header.count = 0;
+
+    fclose(file);
+    return header.count;
+}
+
+static void write_index(const char *file_name, const LibraryEntry *entries, u32 count)
+{
+    LibraryIndexHeader header = {{'C', '8', 'L', 'I'}, LIBRARY_INDEX_VERSION, sizeof(LibraryEntry), count};
+    FILE *file = fopen(file_name, "wb");
+
+    // a read only library still works, it's just analyzed every time.
+    if (file == NULL)
+        return;
+
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(entries, sizeof(LibraryEntry), count, file);
+    fclose(file);
+}
+
+static bool read_rom(const char *file_name, u8 *rom, u32 *size)
+{
+    FILE *file = fopen(file_name, "rb");
+
+    if (file == NULL)
+        return false;
+
+    *size = fread(rom, 1, LIBRARY_MAX_ROM_SIZE, file);
+    fclose(file);
+
+    return *size > 0;
+}
+
+static const LibraryEntry *find_entry_by_name(const LibraryEntry *entries, u32 count, const char *name)
+{
+    // the index is written sorted by name.
+    u32 low = 0;
+    u32 high = count;
+
+    while (low < high)
+    {
+        u32 middle = (low + high) / 2;
+        i32 order = strcmp(entries[middle].name, name);
+
+        if (order == 0)
+            return &entries[middle];
+
+        if (order < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return NULL;
+}
+
+static const LibraryEntry *find_entry_by_hash(const LibraryEntry *entries, u32 count, u64 hash)
+{
+    for (u32 i = 0; i < count; i++)
+    {
+        if (entries[i].hash == hash)
+            return &entries[i];
+    }
+
+    return NULL;
+}
+
+static u8 detect_platform(const u8 *memory, const bool *reachable, u32 size, u8 *uses)
+{
+    // XO-CHIP roms may use the whole 64 KB address space.
+    u8 platform = size > CPU_MEMORY_SIZE - CPU_PROGRAM_START ? LIBRARY_XO_CHIP : LIBRARY_CHIP8;
+
+    for (u16 i = CPU_PROGRAM_START; i + 1 < CPU_MEMORY_SIZE; i++)
+    {
+        if (!reachable[i])
+            continue;
+
+        u16 op_code = (memory[i] << 8) | memory[i + 1];
+        u8 op1 = (op_code & 0xF000) >> 12;
+        u8 op4 = op_code & 0x000F;
+        u8 kk = op_code & 0x00FF;
+
+        if (op1 == 0x08 && op4 >= 0x01 && op4 <= 0x03)
+            *uses |= LIBRARY_USES_LOGIC;
+
+        if (op1 == 0x08 && (op4 == 0x06 || op4 == 0x0E))
+            *uses |= LIBRARY_USES_SHIFT;
+
+        if (op1 == 0x0F && (kk == 0x55 || kk == 0x65))
+            *uses |= LIBRARY_USES_MEMORY;
+
+        if (op1 == 0x0D)
+            *uses |= LIBRARY_USES_DRAW;
+
+        if (op1 == 0x0B)
+            *uses |= LIBRARY_USES_JUMP;
+
+        // long I, register ranges, planes, audio, pitch and scroll up.
+        if (op_code == 0xF000 || op_code == 0xF002 || (op1 == 0x05 && (op4 == 0x02 || op4 == 0x03)) ||
+            (op1 == 0x0F && (kk == 0x01 || kk == 0x3A)) || (op_code & 0xFFF0) == 0x00D0)
+            platform = LIBRARY_XO_CHIP;
+
+        // scrolling, exit, resolution, 16x16 sprites, big font and flags.
+        else if (platform == LIBRARY_CHIP8 &&
+                 ((op_code & 0xFFF0) == 0x00C0 || (op_code >= 0x00FB && op_code <= 0x00FF) ||
+                  (op1 == 0x0D && op4 == 0x00) || (op1 == 0x0F && (kk == 0x30 || kk == 0x75 || kk == 0x85))))
+            platform = LIBRARY_SUPER_CHIP;
+    }
+
+    return platform;
+}
+
+static u8 suggest_quirks(u8 platform, u8 uses)
+{
+    u8 quirks;
+
+    switch (platform)
+    {
+    case LIBRARY_SUPER_CHIP:
+        quirks = LIBRARY_QUIRK_CLIPPING | LIBRARY_QUIRK_SHIFTING | LIBRARY_QUIRK_JUMPING;
+        break;
+    case LIBRARY_XO_CHIP:
+        quirks = LIBRARY_QUIRK_MEMORY;
+        break;
+    default:
+        quirks = LIBRARY_QUIRK_VF_RESET | LIBRARY_QUIRK_MEMORY | LIBRARY_QUIRK_DISPLAY_WAIT | LIBRARY_QUIRK_CLIPPING;
+        break;
+    }
+
+    // quirks of instructions the rom never runs don't matter.
+    if (!(uses & LIBRARY_USES_LOGIC))
+        quirks &= ~LIBRARY_QUIRK_VF_RESET;
+
+    if (!(uses & LIBRARY_USES_MEMORY))
+        quirks &= ~LIBRARY_QUIRK_MEMORY;
+
+    if (!(uses & LIBRARY_USES_DRAW))
+        quirks &= ~(LIBRARY_QUIRK_DISPLAY_WAIT | LIBRARY_QUIRK_CLIPPING);
+
+    if (!(uses & LIBRARY_USES_SHIFT))
+        quirks &= ~LIBRARY_QUIRK_SHIFTING;
+
+    if (!(uses & LIBRARY_USES_JUMP))
+        quirks &= ~LIBRARY_QUIRK_JUMPING;
+
+    return quirks;
+}
+
+static void render_thumbnail(const u8 *rom, u32 size, u16 cycles_per_frame, u8 *thumbnail)
+{
+    Cpu cpu;
+
+    // the font alone would only draw a blank screen anyway.
+    if (!cpu_init(&cpu) || !cpu_load_rom_from_memory(&cpu, rom, size))
+    {
+        memset(thumbnail, 0, GPU_PACKED_FRAME_SIZE);
+        cpu_free(&cpu);
+        return;
+    }
+
+    for (u16 i = 0; i < LIBRARY_THUMBNAIL_FRAMES; i++)
+    {
+        cpu_run(&cpu, cycles_per_frame, NULL);
+        cpu_tick_timers(&cpu);
+    }
+
+    gpu_pack_frame(cpu_get_gpu(&cpu), thumbnail);
+    cpu_free(&cpu);
+}
+
+static i32 compare_entries(const void *a, const void *b)
+{
+    return strcmp(((const LibraryEntry *)a)->name, ((const LibraryEntry *)b)->name);
+}
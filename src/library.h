@@ -0,0 +1,78 @@
+#ifndef __LIBRARY_H__
+#define __LIBRARY_H__
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "types.h"
+#include "gpu.h"
+
+#define LIBRARY_NAME_SIZE 64
+#define LIBRARY_PATH_SIZE 512
+#define LIBRARY_INDEX_FILE ".library"
+#define LIBRARY_INDEX_VERSION 1
+#define LIBRARY_MAX_ROM_SIZE (0x10000 - 0x200)
+#define LIBRARY_THUMBNAIL_FRAMES 120
+
+typedef enum LibraryPlatform
+{
+    LIBRARY_CHIP8,
+    LIBRARY_SUPER_CHIP,
+    LIBRARY_XO_CHIP
+} LibraryPlatform;
+
+/**
+ * Quirks a rom is likely to expect, named as in the usual quirk tests.
+ * Only the quirks of the detected platform that the rom's code can
+ * actually run into are suggested.
+ */
+#define LIBRARY_QUIRK_VF_RESET 0x01
+#define LIBRARY_QUIRK_MEMORY 0x02
+#define LIBRARY_QUIRK_DISPLAY_WAIT 0x04
+#define LIBRARY_QUIRK_CLIPPING 0x08
+#define LIBRARY_QUIRK_SHIFTING 0x10
+#define LIBRARY_QUIRK_JUMPING 0x20
+
+/**
+ * Defines a rom of the library.
+ * The thumbnail is the screen after a couple of seconds running with no
+ * keys pressed, packed as gpu_pack_frame does.
+ */
+typedef struct LibraryEntry
+{
+    char name[LIBRARY_NAME_SIZE];
+    u64 hash;
+    i64 modified;
+    u32 size;
+    u8 platform;
+    u8 quirks;
+    u16 cycles_per_frame;
+    u8 thumbnail[GPU_PACKED_FRAME_SIZE];
+} LibraryEntry;
+
+/**
+ * Defines a rom library: every rom in a directory, sorted by name.
+ * The metadata is cached in an index file inside the directory, and only
+ * roms whose size or modification time changed are analyzed again.
+ */
+typedef struct Library
+{
+    char directory[LIBRARY_PATH_SIZE];
+    LibraryEntry *entries;
+    u32 count;
+    u32 analyzed;
+} Library;
+
+bool library_load(Library *library, const char *directory);
+
+void library_free(Library *library);
+
+void library_get_path(const Library *library, u32 index, char *path, u32 size);
+
+const char *library_get_platform_name(u8 platform);
+
+u64 library_hash(const u8 *data, u32 size);
+
+void library_analyze_rom(const u8 *rom, u32 size, LibraryEntry *entry);
+
+#endif /*__LIBRARY_H__*/
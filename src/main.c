@@ -3,8 +3,112 @@
 #define WIDTH 1024
 #define HEIGHT 720
 #define FPS 60
-#define ROM "roms/INVADERS"
+#define LIBRARY "roms"
+#define LIBRARY_ROWS 17
+#define LIBRARY_ROW_HEIGHT 24
+#define LIBRARY_THUMBNAIL_SCALE 4
+#define CPU_PANEL_WIDTH 720
+#define CPU_PANEL_HEIGHT 240
+#define CPU_PANEL_SLOTS 38
+#define INSTRUCTIONS_PANEL_WIDTH 270
+#define INSTRUCTIONS_PANEL_HEIGHT (HEIGHT - 20)
+#define DEBUG_PANEL_BUDGET 8
+#define DEBUG_INSTRUCTIONS_INTERVAL 6
+#define CYCLES_PER_FRAME 10
+#define TURBO_SLICE 0.012
+#define TURBO_SPEED_WINDOW 0.5
+#define TURBO_MULTIPLIERS 6
+#define RUN_AHEAD_MAX_FRAMES 4
+#define RUN_AHEAD_WINDOW 60
+#define RECORDING "recording.c8r"
+#define EXPORT_NAME "/chip8"
+#define GOVERNOR_MIN_DIVISOR 4
+#define GOVERNOR_MAX_MULTIPLIER 10
+#define PROFILE_TRACE "profile.json"
+#define PROFILE_EVENTS 65536
+#define PROFILE_GRAPH_X 470
+#define PROFILE_GRAPH_Y 50
+#define PROFILE_GRAPH_HEIGHT 100
+#define PROFILE_BAR_WIDTH 2
+
+/**
+ * Fast forward state.
+ * A multiplier of 0 means uncapped: frames are emulated for a
+ * whole slice of host time before presenting one.
+ */
+typedef struct Turbo
+{
+    bool enabled;
+    u8 multiplier_index;
+    u32 window_frames;
+    f64 window_start;
+    f32 speed;
+} Turbo;
+
+/**
+ * The stages of a frame, as profiler zones.
+ * Zone ids are handed out in order after the profiler's own frame zone,
+ * so they're registered in this order. The panel renders are nested in
+ * PROFILE_PANELS, every other stage is outermost and shows in the graph.
+ */
+typedef enum ProfileZone
+{
+    PROFILE_INPUT = PROFILER_FRAME_ZONE + 1,
+    PROFILE_EMULATION,
+    PROFILE_PANELS,
+    PROFILE_CPU_PANEL,
+    PROFILE_INSTRUCTIONS_PANEL,
+    PROFILE_SCREEN,
+    PROFILE_OVERLAYS,
+    PROFILE_PRESENT,
+    PROFILE_ZONES
+} ProfileZone;
+
+/**
+ * Run ahead state.
+ * After each real frame the cpu is saved, emulated a few frames into the
+ * future with the current keys, and restored; only the future framebuffer
+ * is kept for presentation.
+ */
+typedef struct RunAhead
+{
+    u8 frames;
+    CpuState state;
+    Gpu gpu;
+    u32 window_frames;
+    f64 window_real_time;
+    f64 window_ahead_time;
+    f64 real_time;
+    f64 ahead_time;
+} RunAhead;
+
 bool running = false;
+bool browsing = false;
+Library library;
+u32 library_selection = 0;
+char rom[LIBRARY_PATH_SIZE] = "";
+u16 cycles_per_frame = CYCLES_PER_FRAME;
+Governor governor;
+bool governed = true;
+char **instructions = NULL;
+u32 instruction_count = 0;
+Recorder *recorder = NULL;
+Recorder *stopped_recorder = NULL;
+Exporter *exporter = NULL;
+Latency latency;
+bool measuring_latency = false;
+u64 emulated_frames = 0;
+u16 stepped_cycles = 0;
+Profiler *profiler = NULL;
+RunAhead run_ahead;
+Turbo turbo = {false, 0, 0, 0, 0};
+const u32 turbo_multipliers[TURBO_MULTIPLIERS] = {0, 2, 4, 8, 16, 32};
+
+const char *profile_zone_names[PROFILE_ZONES] = {
+    "frame", "input", "emulation", "panels", "cpu panel", "instructions panel", "screen", "overlays", "present"};
+const Color profile_zone_colors[PROFILE_ZONES] = {
+    {255, 255, 255, 255}, {102, 191, 255, 255}, {255, 161, 0, 255}, {200, 122, 255, 255}, {135, 60, 190, 255},
+    {255, 109, 194, 255}, {0, 228, 48, 255}, {255, 203, 0, 255}, {130, 130, 130, 255}};
 
 const i32 keys[16] = {
     KEY_KP_1, KEY_KP_2, KEY_KP_3, KEY_KP_4, /* 1 row */
@@ -13,111 +117,227 @@ const i32 keys[16] = {
     KEY_Z, KEY_X, KEY_C, KEY_V,             /* 4 row */
 };
 
-void draw_instructions(char **instructions, const u32 instruction_count, const Cpu *cpu)
+/**
+ * A pre-formatted text slot of the cpu panel.
+ * The text is only formatted again when the value behind it changes.
+ */
+typedef struct PanelSlot
 {
-    const u32 width = 270;
-    const i32 sx = WIDTH - width + 30;
-    const i32 sy = 10;
-    const i32 font_size = 20;
-    const u16 current_instruction_index = cpu_get_instruction_pointer_index(cpu);
-    const u32 from = current_instruction_index < 5 ? 0 : current_instruction_index - 5;
-    i32 y = sy + 10;
+    u32 value;
+    bool valid;
+    char text[16];
+} PanelSlot;
 
-    DrawRectangleLines(sx - 40, sy, width, HEIGHT - 20, (Color){0, 0, 0, 50});
-    DrawText("INSTRUCTIONS", sx, y, font_size, BLACK);
-    y += font_size + 10;
+/**
+ * The debugger panels, rendered into textures that are only
+ * refreshed when the state they show changes.
+ */
+typedef struct DebugPanels
+{
+    PanelSlot cpu_slots[CPU_PANEL_SLOTS];
+    u8 cpu_cursor;
+    bool cpu_dirty;
+    RenderTexture2D cpu_texture;
+    u32 instructions_from;
+    u16 instructions_current;
+    bool instructions_dirty;
+    u32 instructions_age;
+    RenderTexture2D instructions_texture;
+} DebugPanels;
 
-    printf("from %d", from);
+const char *cpu_slot_labels[CPU_PANEL_SLOTS - 32] = {"I", "PC", "SP", "ST", "DT", "FU"};
 
-    for (u32 i = 0; i < 26 && i + from < instruction_count; i++)
-    {
-        if (current_instruction_index == i + from)
-        {
-            DrawTriangle((Vector2){sx - 5, y + 10}, (Vector2){sx - 25, y}, (Vector2){sx - 25, y + 20}, BLUE);
-            DrawRectangle(sx, y, width - 10, font_size, (Color){0, 121, 241, 50});
-        }
+void load_debug_panels(DebugPanels *panels)
+{
+    memset(panels, 0, sizeof(DebugPanels));
+    panels->cpu_texture = LoadRenderTexture(CPU_PANEL_WIDTH, CPU_PANEL_HEIGHT);
+    panels->instructions_texture = LoadRenderTexture(INSTRUCTIONS_PANEL_WIDTH, INSTRUCTIONS_PANEL_HEIGHT);
+    panels->cpu_dirty = true;
+    panels->instructions_dirty = true;
+}
 
-        DrawText((instructions[i + from] != NULL) ? instructions[i + from] : "NONE", sx, y, font_size, GRAY);
-        y += font_size + 5;
-    }
+void unload_debug_panels(DebugPanels *panels)
+{
+    UnloadRenderTexture(panels->cpu_texture);
+    UnloadRenderTexture(panels->instructions_texture);
 }
 
-void draw_cpu_state(Cpu *cpu)
+u32 get_cpu_slot_value(const Cpu *cpu, u8 slot)
 {
-    const i32 width = 720;
-    const i32 height = 240;
-    const i32 sx = 20;
-    const i32 sy = HEIGHT - height;
-    const i32 font_size = 20;
-    char buffer[32];
-    i32 y = 0;
-    i32 x = 0;
+    switch (slot)
+    {
+    case 0:
+        return cpu->index_register;
+    case 1:
+        return cpu->program_counter;
+    case 2:
+        return cpu->stack_pointer;
+    case 3:
+        return cpu->sound_timer;
+    case 4:
+        return cpu->delay_timer;
+    case 5:
+        return (u32)(cpu_get_fused_hit_rate(cpu) * 100);
+    }
 
-    DrawRectangleLines(sx - 10, sy - 10, width, height, (Color){0, 0, 0, 50});
-    DrawText("CPU", sx, sy, font_size, BLACK);
-    y += 25;
+    if (slot < 22)
+        return cpu->value_registers[slot - 6];
 
-    sprintf(buffer, "I: %X", cpu->index_register);
-    DrawText(buffer, sx, sy + y, font_size, GRAY);
-    y += 25;
+    return cpu->stack[slot - 22];
+}
 
-    sprintf(buffer, "PC: %X", cpu->program_counter);
-    DrawText(buffer, sx, sy + y, font_size, GRAY);
-    y += 25;
+void format_cpu_slot(PanelSlot *panel_slot, u8 slot)
+{
+    if (slot == 5)
+        sprintf(panel_slot->text, "FU: %d%%", panel_slot->value);
+    else if (slot < 6)
+        sprintf(panel_slot->text, "%s: %X", cpu_slot_labels[slot], panel_slot->value);
+    else if (slot < 22)
+        sprintf(panel_slot->text, "V%X: %X", slot - 6, panel_slot->value);
+    else
+        sprintf(panel_slot->text, "S%X: %X", slot - 22, panel_slot->value);
+}
 
-    sprintf(buffer, "SP: %X", cpu->stack_pointer);
-    DrawText(buffer, sx, sy + y, font_size, GRAY);
-    y += 25;
+void update_cpu_panel(DebugPanels *panels, const Cpu *cpu, u8 budget)
+{
+    // walks the slots round robin from where the last frame stopped, so every
+    // slot gets refreshed even when the budget is smaller than the slot count.
+    for (u8 i = 0; i < CPU_PANEL_SLOTS && budget > 0; i++)
+    {
+        u8 slot = (panels->cpu_cursor + i) % CPU_PANEL_SLOTS;
+        PanelSlot *panel_slot = &panels->cpu_slots[slot];
+        u32 value = get_cpu_slot_value(cpu, slot);
 
-    sprintf(buffer, "ST: %X", cpu->sound_timer);
-    DrawText(buffer, sx, sy + y, font_size, GRAY);
-    y += 25;
+        if (panel_slot->valid && panel_slot->value == value)
+            continue;
 
-    sprintf(buffer, "DT: %X", cpu->delay_timer);
-    DrawText(buffer, sx, sy + y, font_size, GRAY);
-    y += 25;
+        panel_slot->value = value;
+        panel_slot->valid = true;
+        format_cpu_slot(panel_slot, slot);
+        panels->cpu_dirty = true;
 
-    y = 25;
-    x = 150;
+        // the next frame starts right after the last slot refreshed, the
+        // ones past it are the longest waiting.
+        if (--budget == 0)
+            panels->cpu_cursor = (slot + 1) % CPU_PANEL_SLOTS;
+    }
+}
 
-    for (u8 i = 0; i < 0x10; i++)
-    {
-        sprintf(buffer, "V%X: %X", i, cpu->value_registers[i]);
-        DrawText(buffer, sx + x, sy + y, font_size, GRAY);
-        y += 25;
+void render_cpu_panel(DebugPanels *panels)
+{
+    const i32 sx = 10;
+    const i32 sy = 10;
+    const i32 font_size = 20;
+    const u8 stack_pointer = panels->cpu_slots[2].value;
+    i32 x = 0;
+    i32 y = 25;
 
-        if (i == 7)
+    BeginTextureMode(panels->cpu_texture);
+    ClearBackground(BLANK);
+    DrawRectangleLines(0, 0, CPU_PANEL_WIDTH, CPU_PANEL_HEIGHT, (Color){0, 0, 0, 50});
+    DrawText("CPU", sx, sy, font_size, BLACK);
+
+    for (u8 slot = 0; slot < CPU_PANEL_SLOTS; slot++)
+    {
+        // first column holds the special registers, then two columns of
+        // value registers and two of stack.
+        if (slot == 6 || slot == 14 || slot == 22 || slot == 30)
         {
             x += 150;
             y = 25;
         }
-    }
-
-    y = 25;
-    x = 450;
 
-    for (u8 i = 0; i < 0x10; i++)
-    {
-        if (i == cpu->stack_pointer)
+        if (slot >= 22 && slot - 22 == stack_pointer)
         {
             DrawTriangle((Vector2){sx + x - 5, sy + y + 10}, (Vector2){sx + x - 25, sy + y}, (Vector2){sx + x - 25, sy + y + 20}, BLUE);
             DrawRectangle(sx + x, sy + y, 140, font_size, (Color){0, 121, 241, 50});
         }
 
-        sprintf(buffer, "S%X: %X", i, cpu->stack[i]);
-        DrawText(buffer, sx + x, sy + y, font_size, GRAY);
-
+        DrawText(panels->cpu_slots[slot].text, sx + x, sy + y, font_size, GRAY);
         y += 25;
+    }
+
+    EndTextureMode();
+    panels->cpu_dirty = false;
+}
+
+void render_instructions_panel(DebugPanels *panels, char **instructions, const u32 instruction_count)
+{
+    const i32 sx = 40;
+    const i32 font_size = 20;
+    const u32 from = panels->instructions_from;
+    i32 y = 10;
+
+    BeginTextureMode(panels->instructions_texture);
+    ClearBackground(BLANK);
+    DrawRectangleLines(0, 0, INSTRUCTIONS_PANEL_WIDTH, INSTRUCTIONS_PANEL_HEIGHT, (Color){0, 0, 0, 50});
+    DrawText("INSTRUCTIONS", sx, y, font_size, BLACK);
+    y += font_size + 10;
 
-        if (i == 7)
+    for (u32 i = 0; i < 26 && i + from < instruction_count; i++)
+    {
+        if (panels->instructions_current == i + from)
         {
-            x += 150;
-            y = 25;
+            DrawTriangle((Vector2){sx - 5, y + 10}, (Vector2){sx - 25, y}, (Vector2){sx - 25, y + 20}, BLUE);
+            DrawRectangle(sx, y, INSTRUCTIONS_PANEL_WIDTH - 10, font_size, (Color){0, 121, 241, 50});
         }
+
+        DrawText((instructions[i + from] != NULL) ? instructions[i + from] : "NONE", sx, y, font_size, GRAY);
+        y += font_size + 5;
+    }
+
+    EndTextureMode();
+    panels->instructions_dirty = false;
+    panels->instructions_age = 0;
+}
+
+void update_debug_panels(DebugPanels *panels, char **instructions, const u32 instruction_count, const Cpu *cpu)
+{
+    const u16 current_instruction_index = cpu_get_instruction_pointer_index(cpu);
+    const u32 from = current_instruction_index < 5 ? 0 : current_instruction_index - 5;
+
+    // while paused every changed slot is refreshed at once, while running
+    // the formatting work per frame is capped by the panel budget.
+    update_cpu_panel(panels, cpu, running ? DEBUG_PANEL_BUDGET : CPU_PANEL_SLOTS);
+
+    if (panels->instructions_current != current_instruction_index || panels->instructions_from != from)
+    {
+        panels->instructions_current = current_instruction_index;
+        panels->instructions_from = from;
+        panels->instructions_dirty = true;
+    }
+
+    panels->instructions_age++;
+
+    if (panels->cpu_dirty)
+    {
+        profiler_begin(profiler, PROFILE_CPU_PANEL);
+        render_cpu_panel(panels);
+        profiler_end(profiler);
+    }
+
+    // the program counter moves every frame while running, so the
+    // disassembly is only refreshed a few times per second.
+    if (panels->instructions_dirty && (!running || panels->instructions_age >= DEBUG_INSTRUCTIONS_INTERVAL))
+    {
+        profiler_begin(profiler, PROFILE_INSTRUCTIONS_PANEL);
+        render_instructions_panel(panels, instructions, instruction_count);
+        profiler_end(profiler);
     }
 }
 
-void draw_gpu(Cpu *cpu)
+void draw_debug_panels(const DebugPanels *panels)
+{
+    // render textures are stored upside down, hence the negative height.
+    DrawTextureRec(panels->cpu_texture.texture,
+                   (Rectangle){0, 0, CPU_PANEL_WIDTH, -CPU_PANEL_HEIGHT},
+                   (Vector2){10, HEIGHT - CPU_PANEL_HEIGHT - 10}, WHITE);
+    DrawTextureRec(panels->instructions_texture.texture,
+                   (Rectangle){0, 0, INSTRUCTIONS_PANEL_WIDTH, -INSTRUCTIONS_PANEL_HEIGHT},
+                   (Vector2){WIDTH - INSTRUCTIONS_PANEL_WIDTH - 10, 10}, WHITE);
+}
+
+void draw_gpu(const Gpu *gpu)
 {
     const i32 sx = 10;
     const i32 sy = 40;
@@ -128,67 +348,685 @@ void draw_gpu(Cpu *cpu)
     {
         for (u8 x = 0; x < GPU_SCREEN_WIDTH; x++)
         {
-            u8 value = gpu_get_pixel(&cpu->gpu, x, y);
+            u8 value = gpu_get_pixel(gpu, x, y);
             DrawRectangle((x * w) + sx, (y * h) + sy, w, h, value == 0 ? (Color){10, 50, 40, 255} : (Color){170, 255, 50, 255});
         }
     }
 }
 
-void check_input(Cpu *cpu)
+void load_game(Cpu *cpu, DebugPanels *panels, const char *file_name, u16 cycles)
+{
+    // reloading passes the current rom back in.
+    if (file_name != rom)
+        snprintf(rom, sizeof(rom), "%s", file_name);
+
+    cycles_per_frame = cycles;
+
+    // the rom's cycles are the nominal speed, the governor may go from a
+    // quarter of it for roms that wait on the timer up to ten times it for
+    // the ones that can't keep up with it.
+    governor_init(&governor, cycles, cycles / GOVERNOR_MIN_DIVISOR, cycles * GOVERNOR_MAX_MULTIPLIER);
+
+    cpu_load_rom(cpu, rom);
+    stepped_cycles = 0;
+    cpu_free_disassembled_code(&instructions, instruction_count);
+    instruction_count = cpu_disassemble_code(cpu, &instructions);
+    panels->instructions_dirty = true;
+}
+
+void select_library_entry(i64 index)
+{
+    if (library.count == 0)
+        return;
+
+    library_selection = index < 0 ? 0 : index >= library.count ? library.count - 1 : index;
+}
+
+void check_library_input(Cpu *cpu, DebugPanels *panels)
+{
+    i32 key = GetKeyPressed();
+
+    if (IsKeyPressed(KEY_DOWN))
+        select_library_entry((i64)library_selection + 1);
+
+    if (IsKeyPressed(KEY_UP))
+        select_library_entry((i64)library_selection - 1);
+
+    if (IsKeyPressed(KEY_PAGE_DOWN))
+        select_library_entry((i64)library_selection + LIBRARY_ROWS);
+
+    if (IsKeyPressed(KEY_PAGE_UP))
+        select_library_entry((i64)library_selection - LIBRARY_ROWS);
+
+    if (IsKeyPressed(KEY_HOME))
+        select_library_entry(0);
+
+    if (IsKeyPressed(KEY_END))
+        select_library_entry(library.count);
+
+    // typing a letter or digit jumps to the first rom starting with it.
+    if (key > 0 && key < 128 && isalnum(key))
+    {
+        for (u32 i = 0; i < library.count; i++)
+        {
+            if (toupper(library.entries[i].name[0]) == toupper(key))
+            {
+                select_library_entry(i);
+                break;
+            }
+        }
+    }
+
+    if (IsKeyPressed(KEY_ENTER) && library.count > 0)
+    {
+        char path[LIBRARY_PATH_SIZE];
+
+        library_get_path(&library, library_selection, path, sizeof(path));
+        load_game(cpu, panels, path, library.entries[library_selection].cycles_per_frame);
+        browsing = false;
+        running = true;
+    }
+
+    // back to the game that was running, if any.
+    if (IsKeyPressed(KEY_F2) && rom[0] != '\0')
+        browsing = false;
+}
+
+void toggle_recording()
+{
+    // the writer finishes on its own and is joined once it's done, see
+    // free_stopped_recorder.
+    if (recorder != NULL)
+    {
+        recorder_stop(recorder);
+        stopped_recorder = recorder;
+        recorder = NULL;
+        return;
+    }
+
+    // a new recording would truncate the file the last one is still
+    // writing.
+    if (stopped_recorder != NULL)
+        return;
+
+    recorder = recorder_create(RECORDING);
+}
+
+void free_stopped_recorder()
+{
+    if (stopped_recorder != NULL && recorder_is_stopped(stopped_recorder))
+    {
+        recorder_free(stopped_recorder);
+        stopped_recorder = NULL;
+    }
+}
+
+void toggle_export()
+{
+    if (exporter != NULL)
+    {
+        exporter_free(exporter);
+        exporter = NULL;
+        return;
+    }
+
+    exporter = exporter_create(EXPORT_NAME);
+}
+
+void toggle_latency()
+{
+    // every measurement starts from empty histograms.
+    measuring_latency = !measuring_latency;
+
+    if (measuring_latency)
+        latency_init(&latency);
+}
+
+void create_profiler()
+{
+    profiler = profiler_create(PROFILE_EVENTS);
+
+    if (profiler == NULL)
+        return;
+
+    for (u16 zone = PROFILE_INPUT; zone < PROFILE_ZONES; zone++)
+        profiler_add_zone(profiler, profile_zone_names[zone]);
+
+    profiler_name_thread(profiler, "main");
+}
+
+void check_profiler_input()
+{
+    if (profiler == NULL)
+        return;
+
+    if (IsKeyPressed(KEY_TAB))
+        profiler_set_enabled(profiler, !profiler->enabled);
+
+    // the trace covers the last PROFILE_EVENTS zones, however old.
+    if (IsKeyPressed(KEY_BACKSPACE) && !profiler_write_trace(profiler, PROFILE_TRACE))
+        perror(PROFILE_TRACE);
+}
+
+u16 get_frame_cycles()
+{
+    return governed ? governor.cycles : cycles_per_frame;
+}
+
+void step_instruction(Cpu *cpu)
+{
+    // stepping keeps emulated time: the timers tick once every frame's
+    // worth of instructions, as they do while running.
+    cpu_clock(cpu);
+
+    if (++stepped_cycles >= get_frame_cycles())
+    {
+        stepped_cycles = 0;
+        cpu_tick_timers(cpu);
+    }
+}
+
+void check_input(Cpu *cpu, DebugPanels *panels)
 {
     for (u8 ki = 0; ki < 16; ki++)
     {
         keyboard_set_key_pressed(&cpu->keyboard, ki, IsKeyDown(keys[ki]));
     }
 
+    // keys held by the readers of the export are pressed along with ours.
+    if (exporter != NULL)
+        cpu->keyboard.memory |= exporter_get_keys(exporter);
+
+    if (measuring_latency)
+        latency_key_event(&latency, cpu, GetTime(), (f64)emulated_frames / FPS);
+
     if (IsKeyPressed(KEY_F10) && !running)
-        cpu_clock(cpu);
+        step_instruction(cpu);
 
     if (IsKeyDown(KEY_F11) && !running)
-        cpu_clock(cpu);
+        step_instruction(cpu);
 
     if (IsKeyPressed(KEY_F5))
         running = !running;
 
     if (IsKeyPressed(KEY_F8))
-        cpu_load_rom(cpu, ROM);
+        load_game(cpu, panels, rom, cycles_per_frame);
+
+    if (IsKeyPressed(KEY_F2) && library.entries != NULL)
+    {
+        browsing = true;
+        running = false;
+    }
+
+    if (IsKeyPressed(KEY_F6))
+        turbo.enabled = !turbo.enabled;
+
+    if (IsKeyPressed(KEY_F7))
+        turbo.multiplier_index = (turbo.multiplier_index + 1) % TURBO_MULTIPLIERS;
+
+    if (IsKeyPressed(KEY_F3))
+        governed = !governed;
+
+    if (IsKeyPressed(KEY_F4))
+        run_ahead.frames = (run_ahead.frames + 1) % (RUN_AHEAD_MAX_FRAMES + 1);
+
+    free_stopped_recorder();
+
+    if (IsKeyPressed(KEY_F9))
+        toggle_recording();
 
-    if (running)
+    if (IsKeyPressed(KEY_F12))
+        toggle_export();
+
+    if (IsKeyPressed(KEY_F1))
+        toggle_latency();
+}
+
+void emulate_frame(Cpu *cpu)
+{
+    // one emulated frame: a batch of instructions and a single 60hz timer
+    // tick, so the timers follow emulated time at any speed.
+    cpu_run(cpu, get_frame_cycles(), NULL);
+    cpu_tick_timers(cpu);
+}
+
+void emulate_recorded_frame(Cpu *cpu)
+{
+    if (measuring_latency)
+        latency_begin_frame(&latency, GetTime());
+
+    // only real frames are recorded and seen by the governor, never the
+    // speculative run ahead ones, which reuse its last budget.
+    if (governed)
+    {
+        governor_run_frame(&governor, cpu);
+        cpu_tick_timers(cpu);
+    }
+    else
     {
-        for (u8 i = 0; i < 10; i++)
+        emulate_frame(cpu);
+    }
+
+    if (recorder != NULL)
+        recorder_push_frame(recorder, cpu_get_gpu(cpu));
+
+    if (exporter != NULL)
+        exporter_publish(exporter, cpu);
+
+    // the framebuffer is only compared once the frame is done, so the
+    // emulated latency is a whole number of frames.
+    emulated_frames++;
+
+    if (measuring_latency)
+        latency_check_draw(&latency, cpu, GetTime(), (f64)emulated_frames / FPS);
+}
+
+u32 emulate_frames(Cpu *cpu, const f64 start)
+{
+    const u32 multiplier = turbo_multipliers[turbo.multiplier_index];
+    u32 frames = 0;
+
+    if (!turbo.enabled)
+    {
+        emulate_recorded_frame(cpu);
+        return 1;
+    }
+
+    if (multiplier > 0)
+    {
+        for (; frames < multiplier; frames++)
+            emulate_recorded_frame(cpu);
+
+        return frames;
+    }
+
+    // uncapped: emulate until the slice is spent, then present once.
+    do
+    {
+        emulate_recorded_frame(cpu);
+        frames++;
+    } while (GetTime() - start < TURBO_SLICE);
+
+    return frames;
+}
+
+void emulate_ahead(Cpu *cpu, const f64 start)
+{
+    const f64 ahead_start = GetTime();
+
+    // the speculative frames run on the real cpu and are rolled back, so
+    // nothing but the framebuffer leaks out of them: the panels, timers and
+    // any sound decision read the restored state.
+    cpu_save_state(cpu, &run_ahead.state);
+
+    for (u8 i = 0; i < run_ahead.frames; i++)
+        emulate_frame(cpu);
+
+    run_ahead.gpu = *cpu_get_gpu(cpu);
+    cpu_load_state(cpu, &run_ahead.state);
+
+    run_ahead.window_real_time += ahead_start - start;
+    run_ahead.window_ahead_time += GetTime() - ahead_start;
+
+    if (++run_ahead.window_frames >= RUN_AHEAD_WINDOW)
+    {
+        run_ahead.real_time = run_ahead.window_real_time / run_ahead.window_frames;
+        run_ahead.ahead_time = run_ahead.window_ahead_time / run_ahead.window_frames;
+        run_ahead.window_frames = 0;
+        run_ahead.window_real_time = 0;
+        run_ahead.window_ahead_time = 0;
+    }
+}
+
+void emulate(Cpu *cpu)
+{
+    const f64 start = GetTime();
+
+    turbo.window_frames += running ? emulate_frames(cpu, start) : 0;
+
+    if (running && !turbo.enabled && run_ahead.frames > 0)
+        emulate_ahead(cpu, start);
+
+    if (start - turbo.window_start >= TURBO_SPEED_WINDOW)
+    {
+        turbo.speed = turbo.window_frames / ((start - turbo.window_start) * FPS);
+        turbo.window_frames = 0;
+        turbo.window_start = start;
+    }
+}
+
+void draw_speed()
+{
+    char buffer[32];
+
+    if (!turbo.enabled)
+    {
+        DrawFPS(10, 10);
+        return;
+    }
+
+    if (turbo_multipliers[turbo.multiplier_index] > 0)
+        sprintf(buffer, "x%d (x%d)", (i32)(turbo.speed + 0.5f), turbo_multipliers[turbo.multiplier_index]);
+    else
+        sprintf(buffer, "x%d", (i32)(turbo.speed + 0.5f));
+
+    DrawText(buffer, 10, 10, 20, LIME);
+}
+
+void draw_run_ahead()
+{
+    char buffer[64];
+
+    if (run_ahead.frames == 0 || turbo.enabled)
+        return;
+
+    // the cost of the speculative frames against the latency they hide.
+    sprintf(buffer, "RUN AHEAD %d: +%.3fms cpu (x%.1f), -%.1fms lag",
+            run_ahead.frames, run_ahead.ahead_time * 1000,
+            run_ahead.real_time > 0 ? run_ahead.ahead_time / run_ahead.real_time : 0,
+            run_ahead.frames * 1000.0 / FPS);
+    DrawText(buffer, 120, 10, 20, GRAY);
+}
+
+void draw_recording()
+{
+    char buffer[64];
+
+    if (recorder == NULL)
+        return;
+
+    sprintf(buffer, "REC %llu (%llu dropped)",
+            (unsigned long long)recorder_get_frame_count(recorder),
+            (unsigned long long)recorder_get_dropped_frame_count(recorder));
+    DrawText(buffer, 10, HEIGHT - 30, 20, RED);
+}
+
+void draw_export()
+{
+    char buffer[EXPORTER_NAME_SIZE + 32];
+
+    if (exporter == NULL)
+        return;
+
+    sprintf(buffer, "SHM %s %llu", exporter->name, (unsigned long long)exporter->frame);
+    DrawText(buffer, 10, HEIGHT - 55, 20, DARKGREEN);
+}
+
+void draw_latency()
+{
+    char buffer[128];
+    const LatencyHistogram *histograms = latency.histograms;
+
+    if (!measuring_latency)
+        return;
+
+    // p50/p99 in ms per stage, as the key changes go through them.
+    sprintf(buffer, "LATENCY in %.1f/%.1f emu %.1f/%.1f present %.1f/%.1f total %.1f/%.1f (%llu)",
+            latency_get_percentile(&histograms[LATENCY_INPUT], 0.5) * 1000,
+            latency_get_percentile(&histograms[LATENCY_INPUT], 0.99) * 1000,
+            latency_get_percentile(&histograms[LATENCY_EMULATION], 0.5) * 1000,
+            latency_get_percentile(&histograms[LATENCY_EMULATION], 0.99) * 1000,
+            latency_get_percentile(&histograms[LATENCY_PRESENT], 0.5) * 1000,
+            latency_get_percentile(&histograms[LATENCY_PRESENT], 0.99) * 1000,
+            latency_get_percentile(&histograms[LATENCY_TOTAL], 0.5) * 1000,
+            latency_get_percentile(&histograms[LATENCY_TOTAL], 0.99) * 1000,
+            (unsigned long long)histograms[LATENCY_TOTAL].count);
+    DrawText(buffer, 10, HEIGHT - 80, 20, MAROON);
+}
+
+void draw_profiler()
+{
+    char buffer[64];
+    const f64 budget = 1.0 / FPS;
+    const i32 legend_y = PROFILE_GRAPH_Y + PROFILE_GRAPH_HEIGHT + 5;
+    u8 legend = 0;
+
+    if (profiler == NULL || !profiler->enabled)
+        return;
+
+    DrawRectangle(PROFILE_GRAPH_X - 5, PROFILE_GRAPH_Y - 5, PROFILER_HISTORY * PROFILE_BAR_WIDTH + 10,
+                  PROFILE_GRAPH_HEIGHT + 70, (Color){0, 0, 0, 160});
+
+    // one stacked bar per frame, newest on the right; the graph is two
+    // frame budgets tall.
+    for (u32 age = 0; age < PROFILER_HISTORY; age++)
+    {
+        const u64 *frame = profiler_get_frame(profiler, age);
+        i32 x = PROFILE_GRAPH_X + (PROFILER_HISTORY - 1 - age) * PROFILE_BAR_WIDTH;
+        i32 y = PROFILE_GRAPH_Y + PROFILE_GRAPH_HEIGHT;
+
+        if (frame == NULL)
+            break;
+
+        for (u16 zone = PROFILE_INPUT; zone < PROFILE_ZONES && y > PROFILE_GRAPH_Y; zone++)
         {
-            cpu_clock(cpu);
+            i32 height = frame[zone] / 1e9 / (2 * budget) * PROFILE_GRAPH_HEIGHT;
+
+            height = height < y - PROFILE_GRAPH_Y ? height : y - PROFILE_GRAPH_Y;
+            DrawRectangle(x, y - height, PROFILE_BAR_WIDTH, height, profile_zone_colors[zone]);
+            y -= height;
         }
     }
+
+    DrawLine(PROFILE_GRAPH_X, PROFILE_GRAPH_Y + PROFILE_GRAPH_HEIGHT / 2,
+             PROFILE_GRAPH_X + PROFILER_HISTORY * PROFILE_BAR_WIDTH, PROFILE_GRAPH_Y + PROFILE_GRAPH_HEIGHT / 2, RED);
+
+    // the average of every stage over the graph, in ms; present includes
+    // the wait for the next frame, so it's the headroom left.
+    for (u16 zone = PROFILER_FRAME_ZONE; zone < PROFILE_ZONES; zone++)
+    {
+        if (zone == PROFILE_CPU_PANEL || zone == PROFILE_INSTRUCTIONS_PANEL)
+            continue;
+
+        sprintf(buffer, "%s %.2fms", profile_zone_names[zone], profiler_get_average(profiler, zone) * 1000);
+        DrawText(buffer, PROFILE_GRAPH_X + (legend % 2) * 120, legend_y + (legend / 2) * 12, 10, profile_zone_colors[zone]);
+        legend++;
+    }
+}
+
+void draw_governor()
+{
+    char buffer[96];
+
+    if (browsing)
+        return;
+
+    if (!governed)
+    {
+        sprintf(buffer, "GOVERNOR OFF: %u cycles", cycles_per_frame);
+        DrawText(buffer, 80, HEIGHT - CPU_PANEL_HEIGHT, 20, GRAY);
+        return;
+    }
+
+    // the budget of the next frame and the rates it was decided from.
+    sprintf(buffer, "%s: %u cycles (%u-%u), dt %d%% key %d%% drw %.1f, %.0fns",
+            governor_get_decision_name(governor.decision), governor.cycles,
+            governor.min_cycles, governor.max_cycles,
+            (i32)(governor.timer_wait_rate * 100), (i32)(governor.key_wait_rate * 100),
+            governor.draw_rate, governor.instruction_time * 1e9);
+    DrawText(buffer, 80, HEIGHT - CPU_PANEL_HEIGHT, 20, GRAY);
+}
+
+void draw_fault(const Cpu *cpu)
+{
+    // a faulted cpu is halted until the rom is reloaded with F8.
+    if (cpu->fault == CPU_FAULT_STACK_OVERFLOW)
+        DrawText("STACK OVERFLOW", 10, 40, 20, RED);
+    else if (cpu->fault == CPU_FAULT_STACK_UNDERFLOW)
+        DrawText("STACK UNDERFLOW", 10, 40, 20, RED);
+    else if (cpu->fault == CPU_FAULT_OUT_OF_MEMORY)
+        DrawText("OUT OF MEMORY", 10, 40, 20, RED);
+}
+
+void draw_thumbnail(const u8 *thumbnail, i32 sx, i32 sy, i32 scale)
+{
+    DrawRectangle(sx, sy, GPU_SCREEN_WIDTH * scale, GPU_SCREEN_HEIGHT * scale, (Color){10, 50, 40, 255});
+
+    for (u16 i = 0; i < GPU_SCREEN_WIDTH * GPU_SCREEN_HEIGHT; i++)
+    {
+        if (thumbnail[i / 8] & (0x80 >> (i % 8)))
+            DrawRectangle(sx + (i % GPU_SCREEN_WIDTH) * scale, sy + (i / GPU_SCREEN_WIDTH) * scale, scale, scale, (Color){170, 255, 50, 255});
+    }
+}
+
+void draw_library()
+{
+    const i32 sx = 10;
+    const i32 sy = 40;
+    const i32 width = GPU_SCREEN_WIDTH * 11;
+    const i32 height = GPU_SCREEN_HEIGHT * 13;
+    const i32 thumbnail_x = sx + width - GPU_SCREEN_WIDTH * LIBRARY_THUMBNAIL_SCALE - 10;
+    char buffer[64];
+
+    DrawRectangle(sx, sy, width, height, (Color){10, 50, 40, 255});
+
+    if (library.count == 0)
+    {
+        DrawText("NO ROMS IN THE LIBRARY", sx + 10, sy + 10, 20, GRAY);
+        return;
+    }
+
+    // only the visible window of the list is drawn, keeping the selection
+    // in the middle whenever possible.
+    u32 from = library_selection < LIBRARY_ROWS / 2 ? 0 : library_selection - LIBRARY_ROWS / 2;
+
+    if (library.count > LIBRARY_ROWS && from > library.count - LIBRARY_ROWS)
+        from = library.count - LIBRARY_ROWS;
+
+    for (u32 i = from; i < library.count && i < from + LIBRARY_ROWS; i++)
+    {
+        i32 y = sy + 10 + (i - from) * LIBRARY_ROW_HEIGHT;
+
+        if (i == library_selection)
+            DrawRectangle(sx + 5, y - 2, thumbnail_x - sx - 15, LIBRARY_ROW_HEIGHT, (Color){0, 121, 241, 80});
+
+        DrawText(library.entries[i].name, sx + 10, y, 20, i == library_selection ? RAYWHITE : GRAY);
+    }
+
+    const LibraryEntry *entry = &library.entries[library_selection];
+    i32 y = sy + 20 + GPU_SCREEN_HEIGHT * LIBRARY_THUMBNAIL_SCALE;
+
+    draw_thumbnail(entry->thumbnail, thumbnail_x, sy + 10, LIBRARY_THUMBNAIL_SCALE);
+
+    DrawText(library_get_platform_name(entry->platform), thumbnail_x, y, 20, LIME);
+    sprintf(buffer, "%u bytes, %u cycles", entry->size, entry->cycles_per_frame);
+    DrawText(buffer, thumbnail_x, y + 25, 20, GRAY);
+
+    sprintf(buffer, "%s%s%s%s%s%s",
+            entry->quirks & LIBRARY_QUIRK_VF_RESET ? "VF " : "",
+            entry->quirks & LIBRARY_QUIRK_MEMORY ? "MEM " : "",
+            entry->quirks & LIBRARY_QUIRK_DISPLAY_WAIT ? "WAIT " : "",
+            entry->quirks & LIBRARY_QUIRK_CLIPPING ? "CLIP " : "",
+            entry->quirks & LIBRARY_QUIRK_SHIFTING ? "SHIFT " : "",
+            entry->quirks & LIBRARY_QUIRK_JUMPING ? "JUMP" : "");
+    DrawText(entry->quirks != 0 ? buffer : "NO QUIRKS", thumbnail_x, y + 50, 20, GRAY);
+
+    sprintf(buffer, "%u roms", library.count);
+    DrawText(buffer, thumbnail_x, sy + height - 30, 20, GRAY);
+}
+
+const Gpu *get_presented_gpu(const Cpu *cpu)
+{
+    if (running && !turbo.enabled && run_ahead.frames > 0)
+        return &run_ahead.gpu;
+
+    return cpu_get_gpu(cpu);
 }
 
-int main()
+int main(int argc, char **argv)
 {
     Cpu cpu;
-    char **instructions = NULL;
+    DebugPanels panels;
+    const char *path = argc > 1 ? argv[1] : LIBRARY;
+
+    if (!cpu_init(&cpu))
+    {
+        fprintf(stderr, "Unable to allocate the framebuffer\n");
+        return 1;
+    }
 
-    cpu_load_rom(&cpu, ROM);
-    u32 instruction_count = cpu_disassemble_code(&cpu, &instructions);
+    create_profiler();
 
     InitWindow(WIDTH, HEIGHT, "Chip 8");
     SetTargetFPS(FPS);
+    load_debug_panels(&panels);
+
+    // a directory opens the library, anything else is loaded as a rom.
+    if (library_load(&library, path))
+        browsing = true;
+    else
+        load_game(&cpu, &panels, path, CYCLES_PER_FRAME);
 
     while (!WindowShouldClose())
     {
+        profiler_begin(profiler, PROFILE_INPUT);
+        check_profiler_input();
+
+        if (browsing)
+            check_library_input(&cpu, &panels);
+        else
+            check_input(&cpu, &panels);
+
+        profiler_end(profiler);
+
+        profiler_begin(profiler, PROFILE_EMULATION);
+        emulate(&cpu);
+        profiler_end(profiler);
+
+        profiler_begin(profiler, PROFILE_PANELS);
+        update_debug_panels(&panels, instructions, instruction_count, &cpu);
+        profiler_end(profiler);
+
+        // raylib batches the draws, most of the work of these stages is
+        // only submitted at the present.
+        profiler_begin(profiler, PROFILE_SCREEN);
         BeginDrawing();
         ClearBackground(RAYWHITE);
 
-        check_input(&cpu);
-        draw_cpu_state(&cpu);
-        draw_instructions(instructions, instruction_count, &cpu);
-        draw_gpu(&cpu);
+        draw_debug_panels(&panels);
 
-        DrawFPS(10, 10);
+        if (browsing)
+            draw_library();
+        else
+            draw_gpu(get_presented_gpu(&cpu));
+
+        profiler_end(profiler);
+
+        profiler_begin(profiler, PROFILE_OVERLAYS);
+        draw_speed();
+        draw_run_ahead();
+        draw_governor();
+        draw_fault(&cpu);
+        draw_recording();
+        draw_export();
+        draw_latency();
+        draw_profiler();
+        profiler_end(profiler);
+
+        profiler_begin(profiler, PROFILE_PRESENT);
         EndDrawing();
+
+        // presenting includes the wait for the next frame.
+        if (measuring_latency)
+            latency_present(&latency, GetTime());
+
+        profiler_end(profiler);
+        profiler_end_frame(profiler);
     }
 
+    if (measuring_latency)
+        latency_print(&latency, stdout);
+
+    recorder_free(recorder);
+    recorder_free(stopped_recorder);
+    exporter_free(exporter);
+    library_free(&library);
+    profiler_free(profiler);
+
+    unload_debug_panels(&panels);
     CloseWindow();
     cpu_free_disassembled_code(&instructions, instruction_count);
+    cpu_free(&cpu);
 
     return 0;
 }
\ No newline at end of file
@@ -1,7 +1,14 @@
 #ifndef __MAIN_H__
 #define __MAIN_H__
 
+#include <ctype.h>
 #include "raylib.h"
 #include "cpu.h"
+#include "recorder.h"
+#include "exporter.h"
+#include "latency.h"
+#include "profiler.h"
+#include "library.h"
+#include "governor.h"
 
 #endif
\ No newline at end of file
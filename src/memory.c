@@ -0,0 +1,112 @@
+#include "memory.h"
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+void *memory_allocate_aligned(u32 size)
+{
+    // rounded up to whole lines, so nothing else shares the last one.
+    u32 aligned_size = (size + MEMORY_CACHE_LINE_SIZE - 1) & ~(MEMORY_CACHE_LINE_SIZE - 1);
+    void *block;
+
+#ifdef _WIN32
+    block = _aligned_malloc(aligned_size, MEMORY_CACHE_LINE_SIZE);
+#else
+    if (posix_memalign(&block, MEMORY_CACHE_LINE_SIZE, aligned_size) != 0)
+        block = NULL;
+#endif
+
+    if (block != NULL)
+        memset(block, 0, aligned_size);
+
+    return block;
+}
+
+void memory_free_aligned(void *block)
+{
+#ifdef _WIN32
+    _aligned_free(block);
+#else
+    free(block);
+#endif
+}
+
+MemoryImage *memory_image_create()
+{
+    MemoryImage *image = memory_allocate_aligned(sizeof(MemoryImage));
+
+    if (image != NULL)
+        image->references = 1;
+
+    return image;
+}
+
+void memory_image_retain(MemoryImage *image)
+{
+    // instances sharing an image may live on different threads.
+    __atomic_add_fetch(&image->references, 1, __ATOMIC_RELAXED);
+}
+
+void memory_image_release(MemoryImage *image)
+{
+    if (image != NULL && __atomic_sub_fetch(&image->references, 1, __ATOMIC_ACQ_REL) == 0)
+        memory_free_aligned(image);
+}
+
+void memory_attach(Memory *memory, MemoryImage *image)
+{
+    memory_image_retain(image);
+    memory_detach(memory);
+
+    memory->image = image;
+
+    for (u8 i = 0; i < MEMORY_PAGE_COUNT; i++)
+        memory->pages[i] = &image->pages[i];
+}
+
+void memory_detach(Memory *memory)
+{
+    for (u8 i = 0; i < MEMORY_PAGE_COUNT; i++)
+        memory_share_page(memory, i);
+
+    memory_image_release(memory->image);
+    memory->image = NULL;
+}
+
+MemoryPage *memory_make_page_private(Memory *memory, u8 page)
+{
+    MemoryPage *copy = memory_allocate_aligned(sizeof(MemoryPage));
+
+    // the page stays shared, the caller decides how to fail the write.
+    if (copy == NULL)
+        return NULL;
+
+    memcpy(copy, memory->pages[page], sizeof(MemoryPage));
+    memory->pages[page] = copy;
+    memory->private_pages |= (1 << page);
+
+    return copy;
+}
+
+void memory_share_page(Memory *memory, u8 page)
+{
+    // drops the private copy and points back to the image page.
+    if ((memory->private_pages & (1 << page)) == 0)
+        return;
+
+    memory_free_aligned(memory->pages[page]);
+    memory->pages[page] = &memory->image->pages[page];
+    memory->private_pages &= ~(1 << page);
+}
+
+void memory_read_block(const Memory *memory, u16 address, u8 *destination, u16 length)
+{
+    for (u16 i = 0; i < length; i++)
+        destination[i] = memory_read(memory, address + i);
+}
+
+u8 memory_get_private_page_count(const Memory *memory)
+{
+    return __builtin_popcount(memory->private_pages);
+}
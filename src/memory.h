@@ -0,0 +1,92 @@
+#ifndef __MEMORY_H__
+#define __MEMORY_H__
+
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+
+#define MEMORY_SIZE 4096
+#define MEMORY_PAGE_SHIFT 8
+#define MEMORY_PAGE_SIZE (1 << MEMORY_PAGE_SHIFT)
+#define MEMORY_PAGE_COUNT (MEMORY_SIZE / MEMORY_PAGE_SIZE)
+#define MEMORY_CACHE_LINE_SIZE 64
+
+/**
+ * Defines a page of memory.
+ * Each byte carries a tag next to it, used by the cpu to store
+ * the fused macro-op starting at that address.
+ */
+typedef struct MemoryPage
+{
+    u8 data[MEMORY_PAGE_SIZE];
+    u8 tags[MEMORY_PAGE_SIZE];
+} MemoryPage;
+
+/**
+ * Defines a memory image.
+ * An image holds the initial contents of the memory (font and rom) and is
+ * shared, read only, between every instance running it.
+ */
+typedef struct MemoryImage
+{
+    MemoryPage pages[MEMORY_PAGE_COUNT];
+    u32 references;
+} MemoryImage;
+
+/**
+ * Defines the memory of an instance.
+ * Reads go through the page table, pages still owned by the image are
+ * copied the first time they're written. When the copy can't be
+ * allocated, memory_get_writable_page returns NULL and the page stays
+ * shared.
+ */
+typedef struct Memory
+{
+    MemoryPage *pages[MEMORY_PAGE_COUNT];
+    MemoryImage *image;
+    u16 private_pages;
+} Memory;
+
+void *memory_allocate_aligned(u32 size);
+
+void memory_free_aligned(void *block);
+
+MemoryImage *memory_image_create();
+
+void memory_image_retain(MemoryImage *image);
+
+void memory_image_release(MemoryImage *image);
+
+void memory_attach(Memory *memory, MemoryImage *image);
+
+void memory_detach(Memory *memory);
+
+MemoryPage *memory_make_page_private(Memory *memory, u8 page);
+
+void memory_share_page(Memory *memory, u8 page);
+
+void memory_read_block(const Memory *memory, u16 address, u8 *destination, u16 length);
+
+u8 memory_get_private_page_count(const Memory *memory);
+
+static inline u8 memory_read(const Memory *memory, u16 address)
+{
+    return memory->pages[(address >> MEMORY_PAGE_SHIFT) & (MEMORY_PAGE_COUNT - 1)]->data[address & (MEMORY_PAGE_SIZE - 1)];
+}
+
+static inline u8 memory_read_tag(const Memory *memory, u16 address)
+{
+    return memory->pages[(address >> MEMORY_PAGE_SHIFT) & (MEMORY_PAGE_COUNT - 1)]->tags[address & (MEMORY_PAGE_SIZE - 1)];
+}
+
+static inline MemoryPage *memory_get_writable_page(Memory *memory, u16 address)
+{
+    u8 page = (address >> MEMORY_PAGE_SHIFT) & (MEMORY_PAGE_COUNT - 1);
+
+    if (memory->private_pages & (1 << page))
+        return memory->pages[page];
+
+    return memory_make_page_private(memory, page);
+}
+
+#endif /*__MEMORY_H__*/
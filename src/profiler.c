@@ -0,0 +1,286 @@
+#include "profiler.h"
+
+static ProfilerThread *get_thread(Profiler *profiler);
+static ProfilerThread *register_thread(Profiler *profiler);
+static void write_event(ProfilerThread *thread, u32 capacity, u16 zone, u64 start, u64 end);
+static void write_thread(const Profiler *profiler, u32 id, ProfilerEvent *events, FILE *file, bool *first);
+
+// the zone stack is per thread, every thread finds its own buffer here.
+// It's keyed by the profiler's id, not its address: a profiler created
+// where a freed one was must not find the freed one's buffer.
+static __thread u64 current_profiler = 0;
+static __thread ProfilerThread *current_thread = NULL;
+static u64 next_profiler_id = 1;
+
+Profiler *profiler_create(u32 capacity)
+{
+    Profiler *profiler = calloc(1, sizeof(Profiler));
+
+    if (profiler == NULL)
+        return NULL;
+
+    // a power of two, so the ring index is a mask.
+    profiler->capacity = 1;
+
+    while (profiler->capacity < capacity)
+        profiler->capacity <<= 1;
+
+    profiler->id = __atomic_fetch_add(&next_profiler_id, 1, __ATOMIC_RELAXED);
+    profiler->epoch = clock_get_nanoseconds();
+    profiler_add_zone(profiler, "frame");
+
+    return profiler;
+}
+
+void profiler_free(Profiler *profiler)
+{
+    if (profiler == NULL)
+        return;
+
+    for (u32 i = 0; i < profiler->thread_count && i < PROFILER_MAX_THREADS; i++)
+        free(profiler->threads[i].events);
+
+    free(profiler);
+}
+
+u16 profiler_add_zone(Profiler *profiler, const char *name)
+{
+    if (profiler->zone_count == PROFILER_MAX_ZONES)
+        return PROFILER_FRAME_ZONE;
+
+    snprintf(profiler->zone_names[profiler->zone_count], PROFILER_ZONE_NAME_SIZE, "%s", name);
+    return profiler->zone_count++;
+}
+
+void profiler_set_enabled(Profiler *profiler, bool enabled)
+{
+    // the breakdown restarts, the ring buffers keep what they have.
+    if (enabled && !profiler->enabled)
+    {
+        for (u32 i = 0; i < profiler->thread_count && i < PROFILER_MAX_THREADS; i++)
+        {
+            profiler->threads[i].frame_start = 0;
+            memset(profiler->threads[i].frame_totals, 0, sizeof(profiler->threads[i].frame_totals));
+        }
+
+        profiler->frame_count = 0;
+    }
+
+    profiler->enabled = enabled;
+}
+
+void profiler_name_thread(Profiler *profiler, const char *name)
+{
+    ProfilerThread *thread = get_thread(profiler);
+
+    if (thread != NULL)
+        snprintf(thread->name, PROFILER_THREAD_NAME_SIZE, "%s", name);
+}
+
+void profiler_begin(Profiler *profiler, u16 zone)
+{
+    if (profiler == NULL || !profiler->enabled)
+        return;
+
+    ProfilerThread *thread = get_thread(profiler);
+
+    if (thread == NULL)
+        return;
+
+    // zones nested too deep aren't recorded, only counted so their ends
+    // don't close the zones around them.
+    if (thread->depth == PROFILER_MAX_DEPTH)
+    {
+        thread->overflow++;
+        return;
+    }
+
+    thread->open_zones[thread->depth] = zone;
+    thread->open_starts[thread->depth] = clock_get_nanoseconds();
+    thread->depth++;
+}
+
+void profiler_end(Profiler *profiler)
+{
+    // not checked against enabled: a zone opened before disabling the
+    // profiler is still closed.
+    ProfilerThread *thread = profiler != NULL && current_profiler == profiler->id ? current_thread : NULL;
+
+    if (thread == NULL || thread->depth == 0)
+        return;
+
+    if (thread->overflow > 0)
+    {
+        thread->overflow--;
+        return;
+    }
+
+    u64 end = clock_get_nanoseconds();
+    u8 depth = --thread->depth;
+    u16 zone = thread->open_zones[depth];
+    u64 start = thread->open_starts[depth];
+
+    write_event(thread, profiler->capacity, zone, start - profiler->epoch, end - profiler->epoch);
+
+    if (depth == 0)
+        thread->frame_totals[zone] += end - start;
+}
+
+void profiler_end_frame(Profiler *profiler)
+{
+    if (profiler == NULL || !profiler->enabled)
+        return;
+
+    ProfilerThread *thread = get_thread(profiler);
+
+    if (thread == NULL)
+        return;
+
+    u64 now = clock_get_nanoseconds();
+
+    // the first frame only starts the clock.
+    if (thread->frame_start != 0)
+    {
+        u64 *frame = profiler->history[profiler->frame_count % PROFILER_HISTORY];
+
+        write_event(thread, profiler->capacity, PROFILER_FRAME_ZONE, thread->frame_start - profiler->epoch,
+                    now - profiler->epoch);
+
+        memcpy(frame, thread->frame_totals, sizeof(thread->frame_totals));
+        frame[PROFILER_FRAME_ZONE] = now - thread->frame_start;
+        profiler->frame_count++;
+    }
+
+    memset(thread->frame_totals, 0, sizeof(thread->frame_totals));
+    thread->frame_start = now;
+}
+
+const u64 *profiler_get_frame(const Profiler *profiler, u32 age)
+{
+    if (age >= profiler->frame_count || age >= PROFILER_HISTORY)
+        return NULL;
+
+    return profiler->history[(profiler->frame_count - 1 - age) % PROFILER_HISTORY];
+}
+
+f64 profiler_get_average(const Profiler *profiler, u16 zone)
+{
+    u32 count = profiler->frame_count < PROFILER_HISTORY ? profiler->frame_count : PROFILER_HISTORY;
+    u64 total = 0;
+
+    if (count == 0)
+        return 0;
+
+    for (u32 i = 0; i < count; i++)
+        total += profiler->history[i][zone];
+
+    return total / 1e9 / count;
+}
+
+bool profiler_write_trace(const Profiler *profiler, const char *file_name)
+{
+    FILE *file = fopen(file_name, "w");
+    ProfilerEvent *events = malloc(profiler->capacity * sizeof(ProfilerEvent));
+    u32 count = __atomic_load_n(&profiler->thread_count, __ATOMIC_ACQUIRE);
+    bool first = true;
+
+    if (file == NULL || events == NULL)
+    {
+        if (file != NULL)
+            fclose(file);
+
+        free(events);
+        return false;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+    for (u32 i = 0; i < count && i < PROFILER_MAX_THREADS; i++)
+        write_thread(profiler, i, events, file, &first);
+
+    fprintf(file, "\n]}\n");
+    free(events);
+
+    return fclose(file) == 0;
+}
+
+static ProfilerThread *get_thread(Profiler *profiler)
+{
+    if (current_profiler == profiler->id)
+        return current_thread;
+
+    current_profiler = profiler->id;
+    current_thread = register_thread(profiler);
+
+    return current_thread;
+}
+
+static ProfilerThread *register_thread(Profiler *profiler)
+{
+    ProfilerEvent *events = malloc(profiler->capacity * sizeof(ProfilerEvent));
+
+    if (events == NULL)
+        return NULL;
+
+    u32 id = __atomic_fetch_add(&profiler->thread_count, 1, __ATOMIC_RELAXED);
+
+    if (id >= PROFILER_MAX_THREADS)
+    {
+        free(events);
+        return NULL;
+    }
+
+    // the trace writer skips the slot until it's ready.
+    ProfilerThread *thread = &profiler->threads[id];
+
+    thread->events = events;
+    snprintf(thread->name, PROFILER_THREAD_NAME_SIZE, "thread %u", id);
+    __atomic_store_n(&thread->ready, true, __ATOMIC_RELEASE);
+
+    return thread;
+}
+
+static void write_event(ProfilerThread *thread, u32 capacity, u16 zone, u64 start, u64 end)
+{
+    ProfilerEvent *event = &thread->events[thread->head & (capacity - 1)];
+
+    event->start = start;
+    event->duration = end - start;
+    event->zone = zone;
+
+    __atomic_store_n(&thread->head, thread->head + 1, __ATOMIC_RELEASE);
+}
+
+static void write_thread(const Profiler *profiler, u32 id, ProfilerEvent *events, FILE *file, bool *first)
+{
+    const ProfilerThread *thread = &profiler->threads[id];
+
+    if (!__atomic_load_n(&thread->ready, __ATOMIC_ACQUIRE))
+        return;
+
+    u64 head = __atomic_load_n(&thread->head, __ATOMIC_ACQUIRE);
+    u64 begin = head > profiler->capacity ? head - profiler->capacity : 0;
+
+    for (u64 i = begin; i < head; i++)
+        events[i & (profiler->capacity - 1)] = thread->events[i & (profiler->capacity - 1)];
+
+    // the events the thread wrote over while they were being copied.
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    u64 after = __atomic_load_n(&thread->head, __ATOMIC_RELAXED);
+
+    if (after > profiler->capacity && after - profiler->capacity > begin)
+        begin = after - profiler->capacity < head ? after - profiler->capacity : head;
+
+    fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+            *first ? "" : ",", id, thread->name);
+    *first = false;
+
+    for (u64 i = begin; i < head; i++)
+    {
+        const ProfilerEvent *event = &events[i & (profiler->capacity - 1)];
+
+        fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                profiler->zone_names[event->zone], event->zone == PROFILER_FRAME_ZONE ? "frame" : "zone", id,
+                event->start / 1e3, event->duration / 1e3);
+    }
+}
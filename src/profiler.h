@@ -0,0 +1,102 @@
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "types.h"
+#include "clock.h"
+
+#define PROFILER_MAX_ZONES 16
+#define PROFILER_MAX_THREADS 16
+#define PROFILER_MAX_DEPTH 8
+#define PROFILER_ZONE_NAME_SIZE 32
+#define PROFILER_THREAD_NAME_SIZE 32
+#define PROFILER_HISTORY 120
+// every zone added by the caller comes after it.
+#define PROFILER_FRAME_ZONE 0
+
+/**
+ * A closed zone: when it began, relative to the profiler's creation, and
+ * how long it took, both in nanoseconds. Nesting isn't stored, the trace
+ * viewers infer it from the times.
+ */
+typedef struct ProfilerEvent
+{
+    u64 start;
+    u32 duration;
+    u16 zone;
+} ProfilerEvent;
+
+/**
+ * The ring buffer of a thread and its open zones.
+ * Only the thread it belongs to writes to it; the head counts every event
+ * written so far and is published after the event, so a reader copies
+ * the last capacity events and drops the ones overwritten meanwhile.
+ */
+typedef struct ProfilerThread
+{
+    ProfilerEvent *events;
+    u64 head;
+    bool ready;
+    char name[PROFILER_THREAD_NAME_SIZE];
+    u64 open_starts[PROFILER_MAX_DEPTH];
+    u16 open_zones[PROFILER_MAX_DEPTH];
+    u8 depth;
+    u32 overflow;
+    u64 frame_start;
+    u64 frame_totals[PROFILER_MAX_ZONES];
+} ProfilerThread;
+
+/**
+ * Defines a scoped zone profiler.
+ * Zones are opened and closed in pairs with profiler_begin and
+ * profiler_end, and may nest. A closed zone costs two clock reads and
+ * one 16 byte write to the calling thread's ring buffer, so it can stay
+ * in the frame loop; while disabled, opening one is a single branch.
+ * Threads are registered the first time they open a zone. Zones opened
+ * on a NULL profiler are ignored, so the calls can stay in place when
+ * it couldn't be created.
+ *
+ * The outermost zones of the thread calling profiler_end_frame are also
+ * summed per frame, and the last PROFILER_HISTORY frames are kept for a
+ * live breakdown; the ring buffers are written as a Chrome trace, which
+ * chrome://tracing and Perfetto open, with profiler_write_trace.
+ */
+typedef struct Profiler
+{
+    u64 id;
+    bool enabled;
+    u32 capacity;
+    u64 epoch;
+    char zone_names[PROFILER_MAX_ZONES][PROFILER_ZONE_NAME_SIZE];
+    u16 zone_count;
+    ProfilerThread threads[PROFILER_MAX_THREADS];
+    u32 thread_count;
+    u64 history[PROFILER_HISTORY][PROFILER_MAX_ZONES];
+    u32 frame_count;
+} Profiler;
+
+Profiler *profiler_create(u32 capacity);
+
+void profiler_free(Profiler *profiler);
+
+u16 profiler_add_zone(Profiler *profiler, const char *name);
+
+void profiler_set_enabled(Profiler *profiler, bool enabled);
+
+void profiler_name_thread(Profiler *profiler, const char *name);
+
+void profiler_begin(Profiler *profiler, u16 zone);
+
+void profiler_end(Profiler *profiler);
+
+void profiler_end_frame(Profiler *profiler);
+
+const u64 *profiler_get_frame(const Profiler *profiler, u32 age);
+
+f64 profiler_get_average(const Profiler *profiler, u16 zone);
+
+bool profiler_write_trace(const Profiler *profiler, const char *file_name);
+
+#endif /*__PROFILER_H__*/
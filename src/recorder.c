@@ -0,0 +1,324 @@
+#include "recorder.h"
+#include <time.h>
+
+#define RECORDING_FRAME_RATE 60
+#define RECORDER_IDLE_SLEEP 2000000
+
+static void *write_frames(void *data);
+static void write_record(FILE *file, const u8 *image, u8 *written, u32 duration, u32 *keyframe_age);
+static void write_varint(FILE *file, u32 value);
+static bool read_record(FILE *file, u8 *image, u32 *duration);
+static bool read_varint(FILE *file, u32 *value);
+static bool write_pbm(const char *output_prefix, i64 index, const u8 *image);
+
+Recorder *recorder_create(const char *file_name)
+{
+    const u8 header[] = {'C', '8', 'R', RECORDING_VERSION, GPU_SCREEN_WIDTH, GPU_SCREEN_HEIGHT, RECORDING_FRAME_RATE};
+    Recorder *recorder = calloc(1, sizeof(Recorder));
+
+    if (recorder == NULL)
+        return NULL;
+
+    recorder->file = fopen(file_name, "wb");
+
+    if (recorder->file == NULL)
+    {
+        perror("Unable to create the recording");
+        free(recorder);
+        return NULL;
+    }
+
+    fwrite(header, 1, sizeof(header), recorder->file);
+
+    if (pthread_create(&recorder->thread, NULL, write_frames, recorder) != 0)
+    {
+        fclose(recorder->file);
+        free(recorder);
+        return NULL;
+    }
+
+    return recorder;
+}
+
+void recorder_free(Recorder *recorder)
+{
+    if (recorder == NULL)
+        return;
+
+    recorder_stop(recorder);
+    pthread_join(recorder->thread, NULL);
+
+    free(recorder);
+}
+
+void recorder_stop(Recorder *recorder)
+{
+    // the writer drains the queue before it exits.
+    __atomic_store_n(&recorder->stopping, true, __ATOMIC_RELEASE);
+}
+
+bool recorder_is_stopped(const Recorder *recorder)
+{
+    return __atomic_load_n(&recorder->stopped, __ATOMIC_ACQUIRE);
+}
+
+void recorder_push_frame(Recorder *recorder, const Gpu *gpu)
+{
+    // only this thread moves the head and only the writer moves the tail.
+    u32 head = recorder->head;
+    u32 tail = __atomic_load_n(&recorder->tail, __ATOMIC_ACQUIRE);
+
+    recorder->frames++;
+    recorder->pending_frames++;
+
+    if (head - tail == RECORDER_QUEUE_SIZE)
+    {
+        recorder->dropped_frames++;
+        return;
+    }
+
+    RecorderFrame *frame = &recorder->queue[head & (RECORDER_QUEUE_SIZE - 1)];
+    gpu_pack_frame(gpu, frame->data);
+    frame->frames = recorder->pending_frames;
+    recorder->pending_frames = 0;
+
+    __atomic_store_n(&recorder->head, head + 1, __ATOMIC_RELEASE);
+}
+
+u64 recorder_get_frame_count(const Recorder *recorder)
+{
+    return recorder->frames;
+}
+
+u64 recorder_get_dropped_frame_count(const Recorder *recorder)
+{
+    return recorder->dropped_frames;
+}
+
+i64 recorder_export_pbm(const char *file_name, const char *output_prefix)
+{
+    u8 header[7];
+    u8 image[GPU_PACKED_FRAME_SIZE] = {0};
+    u32 duration;
+    i64 frames = 0;
+    FILE *file = fopen(file_name, "rb");
+
+    if (file == NULL)
+    {
+        perror("Unable to open the recording");
+        return -1;
+    }
+
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, "C8R", 3) != 0 ||
+        header[3] != RECORDING_VERSION || header[4] != GPU_SCREEN_WIDTH || header[5] != GPU_SCREEN_HEIGHT)
+    {
+        fprintf(stderr, "Unsupported recording: %s\n", file_name);
+        fclose(file);
+        return -1;
+    }
+
+    // a truncated recording, from a crash for instance, exports every
+    // complete record.
+    while (read_record(file, image, &duration))
+    {
+        for (; duration > 0; duration--, frames++)
+        {
+            if (!write_pbm(output_prefix, frames, image))
+            {
+                fclose(file);
+                return -1;
+            }
+        }
+    }
+
+    fclose(file);
+    return frames;
+}
+
+static void *write_frames(void *data)
+{
+    Recorder *recorder = data;
+    const struct timespec idle = {0, RECORDER_IDLE_SLEEP};
+    u8 written[GPU_PACKED_FRAME_SIZE] = {0};
+    u8 current[GPU_PACKED_FRAME_SIZE];
+    u32 duration = 0;
+    u32 keyframe_age = RECORDER_KEYFRAME_INTERVAL;
+
+    while (true)
+    {
+        bool stopping = __atomic_load_n(&recorder->stopping, __ATOMIC_ACQUIRE);
+        u32 head = __atomic_load_n(&recorder->head, __ATOMIC_ACQUIRE);
+        u32 tail = recorder->tail;
+
+        if (tail == head)
+        {
+            if (stopping)
+                break;
+
+            nanosleep(&idle, NULL);
+            continue;
+        }
+
+        for (; tail != head; tail++)
+        {
+            const RecorderFrame *frame = &recorder->queue[tail & (RECORDER_QUEUE_SIZE - 1)];
+
+            // the current image is only written once it changes, with the
+            // frames dropped in between counted as part of it.
+            if (duration > 0 && memcmp(frame->data, current, GPU_PACKED_FRAME_SIZE) == 0)
+            {
+                duration += frame->frames;
+            }
+            else if (duration > 0)
+            {
+                write_record(recorder->file, current, written, duration + frame->frames - 1, &keyframe_age);
+                memcpy(current, frame->data, GPU_PACKED_FRAME_SIZE);
+                duration = 1;
+            }
+            else
+            {
+                memcpy(current, frame->data, GPU_PACKED_FRAME_SIZE);
+                duration = frame->frames;
+            }
+
+            __atomic_store_n(&recorder->tail, tail + 1, __ATOMIC_RELEASE);
+        }
+    }
+
+    if (duration > 0)
+        write_record(recorder->file, current, written, duration + recorder->pending_frames, &keyframe_age);
+
+    // the file is complete once the flag is seen, joining only reclaims
+    // the thread.
+    fclose(recorder->file);
+    __atomic_store_n(&recorder->stopped, true, __ATOMIC_RELEASE);
+
+    return NULL;
+}
+
+static void write_record(FILE *file, const u8 *image, u8 *written, u32 duration, u32 *keyframe_age)
+{
+    u8 type = RECORDING_DELTA;
+
+    // keyframes are xored with a blank image, so a reader can start
+    // decoding from any of them.
+    if (*keyframe_age >= RECORDER_KEYFRAME_INTERVAL)
+    {
+        type = RECORDING_KEYFRAME;
+        memset(written, 0, GPU_PACKED_FRAME_SIZE);
+        *keyframe_age = 0;
+    }
+
+    *keyframe_age += duration;
+    fputc(type, file);
+    write_varint(file, duration);
+
+    for (u16 i = 0; i < GPU_PACKED_FRAME_SIZE;)
+    {
+        u16 start = i;
+
+        while (i < GPU_PACKED_FRAME_SIZE && image[i] == written[i])
+            i++;
+
+        write_varint(file, i - start);
+        start = i;
+
+        // a single unchanged byte between two changes is cheaper as part
+        // of the changed run than as a run of its own.
+        while (i < GPU_PACKED_FRAME_SIZE &&
+               (image[i] != written[i] || (i + 1 < GPU_PACKED_FRAME_SIZE && image[i + 1] != written[i + 1])))
+            i++;
+
+        write_varint(file, i - start);
+
+        for (u16 j = start; j < i; j++)
+            fputc(image[j] ^ written[j], file);
+    }
+
+    memcpy(written, image, GPU_PACKED_FRAME_SIZE);
+}
+
+static void write_varint(FILE *file, u32 value)
+{
+    while (value >= 0x80)
+    {
+        fputc((value & 0x7F) | 0x80, file);
+        value >>= 7;
+    }
+
+    fputc(value, file);
+}
+
+static bool read_record(FILE *file, u8 *image, u32 *duration)
+{
+    i32 type = fgetc(file);
+
+    if (type == EOF || !read_varint(file, duration))
+        return false;
+
+    if (type == RECORDING_KEYFRAME)
+        memset(image, 0, GPU_PACKED_FRAME_SIZE);
+
+    for (u16 i = 0; i < GPU_PACKED_FRAME_SIZE;)
+    {
+        u32 unchanged;
+        u32 changed;
+
+        if (!read_varint(file, &unchanged) || !read_varint(file, &changed) ||
+            unchanged + changed == 0 || i + unchanged + changed > GPU_PACKED_FRAME_SIZE)
+            return false;
+
+        for (i += unchanged; changed > 0; changed--, i++)
+        {
+            i32 value = fgetc(file);
+
+            if (value == EOF)
+                return false;
+
+            image[i] ^= value;
+        }
+    }
+
+    return true;
+}
+
+static bool read_varint(FILE *file, u32 *value)
+{
+    *value = 0;
+
+    for (u8 shift = 0; shift < 32; shift += 7)
+    {
+        i32 byte = fgetc(file);
+
+        if (byte == EOF)
+            return false;
+
+        *value |= (u32)(byte & 0x7F) << shift;
+
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+static bool write_pbm(const char *output_prefix, i64 index, const u8 *image)
+{
+    char file_name[512];
+
+    snprintf(file_name, sizeof(file_name), "%s%06lld.pbm", output_prefix, (long long)index);
+    FILE *file = fopen(file_name, "wb");
+
+    if (file == NULL)
+    {
+        perror("Unable to write the frame");
+        return false;
+    }
+
+    // packed frames are already laid out as binary pbm rows.
+    fprintf(file, "P4\n%d %d\n", GPU_SCREEN_WIDTH, GPU_SCREEN_HEIGHT);
+    fwrite(image, 1, GPU_PACKED_FRAME_SIZE, file);
+    fclose(file);
+
+    return true;
+}
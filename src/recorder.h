@@ -0,0 +1,85 @@
+#ifndef __RECORDER_H__
+#define __RECORDER_H__
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "types.h"
+#include "gpu.h"
+
+#define RECORDER_QUEUE_SIZE 256
+#define RECORDER_KEYFRAME_INTERVAL 600
+
+/**
+ * Recording file format (.c8r).
+ *
+ * A header, "C8R" followed by a version byte, the screen width, height
+ * and frame rate (one byte each), then one record per distinct frame:
+ *
+ *  - u8 type: RECORDING_DELTA or RECORDING_KEYFRAME.
+ *  - varint duration: how many emulated frames the image stays on screen.
+ *  - the image, packed one bit per pixel (see gpu_pack_frame) and xored
+ *    with the previous image, or with a blank one for keyframes, as runs
+ *    of (varint unchanged bytes, varint changed bytes, changed bytes...)
+ *    until the 256 bytes of the frame are covered.
+ *
+ * Frames equal to the previous one only extend its duration, so a still
+ * screen costs nothing until it changes. Varints are little endian base
+ * 128, 7 bits per byte.
+ */
+#define RECORDING_VERSION 1
+#define RECORDING_DELTA 0
+#define RECORDING_KEYFRAME 1
+
+/**
+ * A frame waiting in the recorder queue.
+ * Frames counts the frames dropped right before this one, plus one.
+ */
+typedef struct RecorderFrame
+{
+    u8 data[GPU_PACKED_FRAME_SIZE];
+    u32 frames;
+} RecorderFrame;
+
+/**
+ * Defines a gameplay recorder.
+ * Frames are pushed from the emulation thread into a single producer,
+ * single consumer queue and encoded and written by a background thread.
+ * Pushing never blocks: when the queue is full the frame is dropped and
+ * the previous one is held for longer instead.
+ * Stopping doesn't block either: recorder_stop only asks the writer to
+ * drain the queue and close the file, and recorder_free joins it once
+ * recorder_is_stopped says it's done (or whenever the caller can wait).
+ */
+typedef struct Recorder
+{
+    RecorderFrame queue[RECORDER_QUEUE_SIZE];
+    u32 head;
+    u32 tail;
+    u32 pending_frames;
+    u64 frames;
+    u64 dropped_frames;
+    bool stopping;
+    bool stopped;
+    pthread_t thread;
+    FILE *file;
+} Recorder;
+
+Recorder *recorder_create(const char *file_name);
+
+void recorder_free(Recorder *recorder);
+
+void recorder_stop(Recorder *recorder);
+
+bool recorder_is_stopped(const Recorder *recorder);
+
+void recorder_push_frame(Recorder *recorder, const Gpu *gpu);
+
+u64 recorder_get_frame_count(const Recorder *recorder);
+
+u64 recorder_get_dropped_frame_count(const Recorder *recorder);
+
+i64 recorder_export_pbm(const char *file_name, const char *output_prefix);
+
+#endif /*__RECORDER_H__*/
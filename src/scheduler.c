@@ -0,0 +1,347 @@
+#include "scheduler.h"
+
+static void *run_worker(void *data);
+static void run_chunks(Scheduler *scheduler);
+static u32 run_instance(Scheduler *scheduler, SchedulerInstance *instance);
+static void park_blocked(Scheduler *scheduler);
+static void make_runnable(Scheduler *scheduler, u32 id);
+static void link_timer(Scheduler *scheduler, u32 id, u8 delay);
+static void unlink_timer(Scheduler *scheduler, u32 id);
+static void catch_up_timers(Cpu *cpu, u64 elapsed);
+
+Scheduler *scheduler_create(u16 cycles_per_frame, u32 threads)
+{
+    Scheduler *scheduler = calloc(1, sizeof(Scheduler));
+
+    if (scheduler == NULL)
+        return NULL;
+
+    scheduler->cycles_per_frame = cycles_per_frame;
+
+    for (u32 i = 0; i < SCHEDULER_WHEEL_SIZE; i++)
+        scheduler->wheel[i] = SCHEDULER_NONE;
+
+    pthread_mutex_init(&scheduler->lock, NULL);
+    pthread_cond_init(&scheduler->start, NULL);
+    pthread_cond_init(&scheduler->done, NULL);
+
+    // the thread running the frames takes its share, so it counts as one.
+    if (threads > 1)
+    {
+        scheduler->workers = calloc(threads - 1, sizeof(pthread_t));
+
+        while (scheduler->workers != NULL && scheduler->worker_count < threads - 1 &&
+               pthread_create(&scheduler->workers[scheduler->worker_count], NULL, run_worker, scheduler) == 0)
+        {
+            scheduler->worker_count++;
+        }
+    }
+
+    return scheduler;
+}
+
+void scheduler_free(Scheduler *scheduler)
+{
+    if (scheduler == NULL)
+        return;
+
+    pthread_mutex_lock(&scheduler->lock);
+    scheduler->stopping = true;
+    pthread_cond_broadcast(&scheduler->start);
+    pthread_mutex_unlock(&scheduler->lock);
+
+    for (u32 i = 0; i < scheduler->worker_count; i++)
+        pthread_join(scheduler->workers[i], NULL);
+
+    pthread_mutex_destroy(&scheduler->lock);
+    pthread_cond_destroy(&scheduler->start);
+    pthread_cond_destroy(&scheduler->done);
+
+    free(scheduler->workers);
+    free(scheduler->instances);
+    free(scheduler->runnable);
+    free(scheduler);
+}
+
+u32 scheduler_add(Scheduler *scheduler, Cpu *cpu)
+{
+    if (scheduler->count == scheduler->capacity)
+    {
+        u32 capacity = scheduler->capacity > 0 ? scheduler->capacity * 2 : 64;
+        SchedulerInstance *instances = realloc(scheduler->instances, capacity * sizeof(SchedulerInstance));
+
+        if (instances == NULL)
+            return SCHEDULER_NONE;
+
+        scheduler->instances = instances;
+
+        u32 *runnable = realloc(scheduler->runnable, capacity * sizeof(u32));
+
+        if (runnable == NULL)
+            return SCHEDULER_NONE;
+
+        scheduler->runnable = runnable;
+        scheduler->capacity = capacity;
+    }
+
+    u32 id = scheduler->count++;
+    SchedulerInstance *instance = &scheduler->instances[id];
+
+    // new instances start halted and are made runnable like any woken one.
+    instance->cpu = cpu;
+    instance->state = SCHEDULER_HALTED;
+    instance->parked_tick = scheduler->tick;
+    instance->next = SCHEDULER_NONE;
+    instance->previous = SCHEDULER_NONE;
+    scheduler->stats.halted++;
+
+    make_runnable(scheduler, id);
+    return id;
+}
+
+void scheduler_run_frame(Scheduler *scheduler)
+{
+    u32 id = scheduler->wheel[scheduler->tick % SCHEDULER_WHEEL_SIZE];
+
+    // the wheel slot of this tick holds every timer wait that ends now.
+    while (id != SCHEDULER_NONE)
+    {
+        u32 next = scheduler->instances[id].next;
+        make_runnable(scheduler, id);
+        id = next;
+    }
+
+    scheduler->next_chunk = 0;
+    scheduler->frame_instructions = 0;
+
+    if (scheduler->worker_count > 0 && scheduler->runnable_count > SCHEDULER_CHUNK)
+    {
+        pthread_mutex_lock(&scheduler->lock);
+        scheduler->generation++;
+        scheduler->busy_workers = scheduler->worker_count;
+        pthread_cond_broadcast(&scheduler->start);
+        pthread_mutex_unlock(&scheduler->lock);
+
+        run_chunks(scheduler);
+
+        pthread_mutex_lock(&scheduler->lock);
+
+        while (scheduler->busy_workers > 0)
+            pthread_cond_wait(&scheduler->done, &scheduler->lock);
+
+        pthread_mutex_unlock(&scheduler->lock);
+    }
+    else
+    {
+        run_chunks(scheduler);
+    }
+
+    scheduler->tick++;
+    park_blocked(scheduler);
+
+    scheduler->stats.instructions = scheduler->frame_instructions;
+    scheduler->stats.ticks = scheduler->tick;
+}
+
+void scheduler_set_keys(Scheduler *scheduler, u32 id, u16 keys)
+{
+    SchedulerInstance *instance = &scheduler->instances[id];
+
+    instance->cpu->keyboard.memory = keys;
+
+    if (instance->state == SCHEDULER_KEY_WAIT && keys != 0)
+        make_runnable(scheduler, id);
+}
+
+void scheduler_wake(Scheduler *scheduler, u32 id)
+{
+    make_runnable(scheduler, id);
+}
+
+SchedulerState scheduler_get_state(const Scheduler *scheduler, u32 id)
+{
+    return scheduler->instances[id].state;
+}
+
+void scheduler_get_stats(const Scheduler *scheduler, SchedulerStats *stats)
+{
+    *stats = scheduler->stats;
+}
+
+static void *run_worker(void *data)
+{
+    Scheduler *scheduler = data;
+    u64 generation = 0;
+
+    pthread_mutex_lock(&scheduler->lock);
+
+    while (true)
+    {
+        while (!scheduler->stopping && scheduler->generation == generation)
+            pthread_cond_wait(&scheduler->start, &scheduler->lock);
+
+        if (scheduler->stopping)
+            break;
+
+        generation = scheduler->generation;
+        pthread_mutex_unlock(&scheduler->lock);
+
+        run_chunks(scheduler);
+
+        pthread_mutex_lock(&scheduler->lock);
+
+        if (--scheduler->busy_workers == 0)
+            pthread_cond_signal(&scheduler->done);
+    }
+
+    pthread_mutex_unlock(&scheduler->lock);
+    return NULL;
+}
+
+static void run_chunks(Scheduler *scheduler)
+{
+    u64 instructions = 0;
+
+    // chunks are taken in turns, so a thread that drew cheap instances
+    // picks up more of them.
+    while (true)
+    {
+        u32 begin = __atomic_fetch_add(&scheduler->next_chunk, SCHEDULER_CHUNK, __ATOMIC_RELAXED);
+
+        if (begin >= scheduler->runnable_count)
+            break;
+
+        u32 end = begin + SCHEDULER_CHUNK < scheduler->runnable_count ? begin + SCHEDULER_CHUNK : scheduler->runnable_count;
+
+        for (u32 i = begin; i < end; i++)
+            instructions += run_instance(scheduler, &scheduler->instances[scheduler->runnable[i]]);
+    }
+
+    __atomic_fetch_add(&scheduler->frame_instructions, instructions, __ATOMIC_RELAXED);
+}
+
+static u32 run_instance(Scheduler *scheduler, SchedulerInstance *instance)
+{
+    Cpu *cpu = instance->cpu;
+    CpuStopReason reason = CPU_STOP_CYCLES;
+    u32 executed = 0;
+
+    while (executed < scheduler->cycles_per_frame)
+    {
+        executed += cpu_run(cpu, scheduler->cycles_per_frame - executed, &reason);
+
+        // a breakpoint ends the instance's frame but doesn't park it.
+        if (reason == CPU_STOP_KEY_WAIT || reason == CPU_STOP_TIMER_WAIT ||
+            reason == CPU_STOP_BREAKPOINT || reason == CPU_STOP_FAULT)
+            break;
+    }
+
+    cpu_tick_timers(cpu);
+
+    // only the state is written here, the lists are updated once every
+    // thread is done.
+    if (reason == CPU_STOP_KEY_WAIT)
+        instance->state = SCHEDULER_KEY_WAIT;
+    else if (reason == CPU_STOP_TIMER_WAIT && cpu->delay_timer > 0)
+        instance->state = SCHEDULER_TIMER_WAIT;
+    else if (reason == CPU_STOP_FAULT)
+        instance->state = SCHEDULER_HALTED;
+
+    return executed;
+}
+
+static void park_blocked(Scheduler *scheduler)
+{
+    u32 count = 0;
+
+    for (u32 i = 0; i < scheduler->runnable_count; i++)
+    {
+        u32 id = scheduler->runnable[i];
+        SchedulerInstance *instance = &scheduler->instances[id];
+
+        if (instance->state == SCHEDULER_RUNNABLE)
+        {
+            scheduler->runnable[count++] = id;
+            continue;
+        }
+
+        instance->parked_tick = scheduler->tick;
+
+        if (instance->state == SCHEDULER_KEY_WAIT)
+            scheduler->stats.key_waiting++;
+        else if (instance->state == SCHEDULER_HALTED)
+            scheduler->stats.halted++;
+        else
+            link_timer(scheduler, id, instance->cpu->delay_timer);
+    }
+
+    scheduler->runnable_count = count;
+    scheduler->stats.runnable = count;
+}
+
+static void make_runnable(Scheduler *scheduler, u32 id)
+{
+    SchedulerInstance *instance = &scheduler->instances[id];
+
+    switch (instance->state)
+    {
+    case SCHEDULER_RUNNABLE:
+        return;
+    case SCHEDULER_KEY_WAIT:
+        scheduler->stats.key_waiting--;
+        break;
+    case SCHEDULER_TIMER_WAIT:
+        unlink_timer(scheduler, id);
+        break;
+    case SCHEDULER_HALTED:
+        scheduler->stats.halted--;
+        break;
+    }
+
+    // the timers kept running while the instance was parked.
+    catch_up_timers(instance->cpu, scheduler->tick - instance->parked_tick);
+
+    instance->state = SCHEDULER_RUNNABLE;
+    scheduler->runnable[scheduler->runnable_count++] = id;
+    scheduler->stats.runnable++;
+}
+
+static void link_timer(Scheduler *scheduler, u32 id, u8 delay)
+{
+    SchedulerInstance *instance = &scheduler->instances[id];
+    u32 *slot = &scheduler->wheel[(scheduler->tick + delay) % SCHEDULER_WHEEL_SIZE];
+
+    instance->slot = (scheduler->tick + delay) % SCHEDULER_WHEEL_SIZE;
+    instance->previous = SCHEDULER_NONE;
+    instance->next = *slot;
+
+    if (*slot != SCHEDULER_NONE)
+        scheduler->instances[*slot].previous = id;
+
+    *slot = id;
+    scheduler->stats.timer_waiting++;
+}
+
+static void unlink_timer(Scheduler *scheduler, u32 id)
+{
+    SchedulerInstance *instance = &scheduler->instances[id];
+
+    // the slot is kept, the cpu may have been changed while it was parked.
+    if (instance->previous != SCHEDULER_NONE)
+        scheduler->instances[instance->previous].next = instance->next;
+    else
+        scheduler->wheel[instance->slot] = instance->next;
+
+    if (instance->next != SCHEDULER_NONE)
+        scheduler->instances[instance->next].previous = instance->previous;
+
+    instance->next = SCHEDULER_NONE;
+    instance->previous = SCHEDULER_NONE;
+    scheduler->stats.timer_waiting--;
+}
+
+static void catch_up_timers(Cpu *cpu, u64 elapsed)
+{
+    cpu->delay_timer = cpu->delay_timer > elapsed ? cpu->delay_timer - elapsed : 0;
+    cpu->sound_timer = cpu->sound_timer > elapsed ? cpu->sound_timer - elapsed : 0;
+}
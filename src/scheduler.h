@@ -0,0 +1,103 @@
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "types.h"
+#include "cpu.h"
+
+// delay timers go up to 255 ticks, so a single wheel turn covers them all.
+#define SCHEDULER_WHEEL_SIZE 256
+#define SCHEDULER_CHUNK 32
+#define SCHEDULER_NONE 0xFFFFFFFF
+
+typedef enum SchedulerState
+{
+    SCHEDULER_RUNNABLE,
+    SCHEDULER_KEY_WAIT,
+    SCHEDULER_TIMER_WAIT,
+    SCHEDULER_HALTED
+} SchedulerState;
+
+/**
+ * An instance of the pool. Parked instances keep the tick they were parked
+ * on, their timers are caught up when they wake. Timer waits are linked
+ * in the wheel slot of their deadline.
+ */
+typedef struct SchedulerInstance
+{
+    Cpu *cpu;
+    u8 state;
+    u8 slot;
+    u64 parked_tick;
+    u32 next;
+    u32 previous;
+} SchedulerInstance;
+
+/**
+ * Counts of the instances in each state, and what the last frame ran.
+ */
+typedef struct SchedulerStats
+{
+    u32 runnable;
+    u32 key_waiting;
+    u32 timer_waiting;
+    u32 halted;
+    u64 instructions;
+    u64 ticks;
+} SchedulerStats;
+
+/**
+ * Defines a cooperative scheduler for a pool of cpus.
+ * Every frame runs each runnable instance for a batch of cycles and ticks
+ * its timers. An instance that blocks on Fx0A is parked until a key is
+ * pressed on it, one spinning on the delay timer until the tick the timer
+ * reaches zero, and one that faulted until it's woken; parked instances
+ * cost nothing per frame. Runnable instances are split between the worker
+ * threads in chunks.
+ *
+ * The pool doesn't own the cpus, and only scheduler_run_frame may run
+ * them while they're in the pool. Every other call must be made from the
+ * thread running the frames, between frames.
+ */
+typedef struct Scheduler
+{
+    SchedulerInstance *instances;
+    u32 count;
+    u32 capacity;
+    u32 *runnable;
+    u32 runnable_count;
+    u32 wheel[SCHEDULER_WHEEL_SIZE];
+    SchedulerStats stats;
+    u64 tick;
+    u16 cycles_per_frame;
+    u32 next_chunk;
+    u64 frame_instructions;
+    pthread_t *workers;
+    u32 worker_count;
+    u32 busy_workers;
+    u64 generation;
+    bool stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+} Scheduler;
+
+Scheduler *scheduler_create(u16 cycles_per_frame, u32 threads);
+
+void scheduler_free(Scheduler *scheduler);
+
+u32 scheduler_add(Scheduler *scheduler, Cpu *cpu);
+
+void scheduler_run_frame(Scheduler *scheduler);
+
+void scheduler_set_keys(Scheduler *scheduler, u32 id, u16 keys);
+
+void scheduler_wake(Scheduler *scheduler, u32 id);
+
+SchedulerState scheduler_get_state(const Scheduler *scheduler, u32 id);
+
+void scheduler_get_stats(const Scheduler *scheduler, SchedulerStats *stats);
+
+#endif /*__SCHEDULER_H__*/
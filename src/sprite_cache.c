@@ -0,0 +1,85 @@
+#include "sprite_cache.h"
+#include "gpu.h"
+
+static inline SpriteCacheEntry *get_entry(SpriteCache *cache, u16 address);
+static inline u8 get_page(u16 address);
+
+SpriteCache *sprite_cache_create()
+{
+    return calloc(1, sizeof(SpriteCache));
+}
+
+void sprite_cache_free(SpriteCache *cache)
+{
+    free(cache);
+}
+
+void sprite_cache_clear(SpriteCache *cache)
+{
+    for (u8 i = 0; i < SPRITE_CACHE_SIZE; i++)
+        cache->entries[i].length = 0;
+}
+
+const u64 *sprite_cache_get(SpriteCache *cache, const Memory *memory, u16 address, u8 length, bool *hit)
+{
+    address &= MEMORY_SIZE - 1;
+
+    SpriteCacheEntry *entry = get_entry(cache, address);
+    *hit = entry->address == address && entry->length >= length;
+
+    if (!*hit)
+    {
+        u8 sprite[SPRITE_CACHE_MAX_ROWS];
+
+        memory_read_block(memory, address, sprite, length);
+        gpu_expand_sprite(sprite, length, entry->rows);
+        entry->address = address;
+        entry->length = length;
+    }
+
+    return entry->rows;
+}
+
+void sprite_cache_invalidate(SpriteCache *cache, u16 address)
+{
+    // only the entries starting up to SPRITE_CACHE_MAX_ROWS - 1 bytes before
+    // the written address can cover it.
+    for (u8 offset = 0; offset < SPRITE_CACHE_MAX_ROWS; offset++)
+    {
+        u16 start = (address - offset) & (MEMORY_SIZE - 1);
+        SpriteCacheEntry *entry = get_entry(cache, start);
+
+        if (entry->address == start && entry->length > offset)
+            entry->length = 0;
+    }
+}
+
+void sprite_cache_invalidate_pages(SpriteCache *cache, u16 pages)
+{
+    for (u8 i = 0; i < SPRITE_CACHE_SIZE; i++)
+    {
+        SpriteCacheEntry *entry = &cache->entries[i];
+
+        if (entry->length == 0)
+            continue;
+
+        // a sprite spans two pages at most.
+        u16 first = 1 << get_page(entry->address);
+        u16 last = 1 << get_page(entry->address + entry->length - 1);
+
+        if (pages & (first | last))
+            entry->length = 0;
+    }
+}
+
+static inline SpriteCacheEntry *get_entry(SpriteCache *cache, u16 address)
+{
+    // sprites tend to sit next to each other, or 64 bytes apart in tables,
+    // so the high bits are folded in.
+    return &cache->entries[(address ^ (address >> 5)) & (SPRITE_CACHE_SIZE - 1)];
+}
+
+static inline u8 get_page(u16 address)
+{
+    return (address >> MEMORY_PAGE_SHIFT) & (MEMORY_PAGE_COUNT - 1);
+}
@@ -0,0 +1,46 @@
+#ifndef __SPRITE_CACHE_H__
+#define __SPRITE_CACHE_H__
+
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "memory.h"
+
+#define SPRITE_CACHE_SIZE 32
+#define SPRITE_CACHE_MAX_ROWS 15
+
+/**
+ * Defines a cached sprite.
+ * Holds the rows read from address, already expanded for the gpu
+ * (see gpu_expand_sprite). An entry with no rows is empty.
+ */
+typedef struct SpriteCacheEntry
+{
+    u64 rows[SPRITE_CACHE_MAX_ROWS];
+    u16 address;
+    u8 length;
+} SpriteCacheEntry;
+
+/**
+ * Defines a sprite cache.
+ * A direct mapped table keyed by the sprite address; a draw with fewer
+ * rows than the cached entry is still a hit.
+ */
+typedef struct SpriteCache
+{
+    SpriteCacheEntry entries[SPRITE_CACHE_SIZE];
+} SpriteCache;
+
+SpriteCache *sprite_cache_create();
+
+void sprite_cache_free(SpriteCache *cache);
+
+void sprite_cache_clear(SpriteCache *cache);
+
+const u64 *sprite_cache_get(SpriteCache *cache, const Memory *memory, u16 address, u8 length, bool *hit);
+
+void sprite_cache_invalidate(SpriteCache *cache, u16 address);
+
+void sprite_cache_invalidate_pages(SpriteCache *cache, u16 pages);
+
+#endif /*__SPRITE_CACHE_H__*/
@@ -13,4 +13,7 @@ typedef short i16;
 typedef int i32;
 typedef long i64;
 
+typedef float f32;
+typedef double f64;
+
 #endif /*__TYPES_H__*/
\ No newline at end of file
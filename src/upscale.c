@@ -0,0 +1,273 @@
+#include "upscale.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// the row fill may store up to 7 pixels past the end of the row.
+#define UPSCALE_ROW_SIZE (GPU_SCREEN_WIDTH * UPSCALE_MAX_SCALE + 8)
+#define UPSCALE_FIRST_PIXEL (1ULL << 63)
+
+static void render_nearest(const Upscaler *upscaler, const Gpu *gpu, u8 *rgba, u32 pitch);
+static void render_epx(const Upscaler *upscaler, const Gpu *gpu, u8 *rgba, u32 pitch);
+static void render_scanlines(Upscaler *upscaler, const Gpu *gpu, u8 *rgba, u32 pitch);
+static void fill_row(u32 *row, const u32 *colors, u16 count, u8 even_span, u8 odd_span);
+static inline void fill_span(u32 *destination, u32 color, u8 span);
+static void copy_row(const u32 *row, u32 width, u8 *rgba, u32 pitch, u32 y, u32 count);
+static void get_rows(const Gpu *gpu, u64 *rows);
+static void update_phosphor_colors(Upscaler *upscaler);
+static inline u32 get_color(UpscaleColor color);
+static inline u32 blend_colors(UpscaleColor from, UpscaleColor to, u8 amount);
+
+void upscaler_init(Upscaler *upscaler, UpscaleFilter filter, u8 scale)
+{
+    memset(upscaler, 0, sizeof(Upscaler));
+
+    upscaler->filter = filter;
+    upscaler->scale = scale < 1 ? 1 : scale > UPSCALE_MAX_SCALE ? UPSCALE_MAX_SCALE : scale;
+
+    // the frontend colors.
+    upscaler_set_palette(upscaler, (UpscaleColor){10, 50, 40, 255}, (UpscaleColor){170, 255, 50, 255});
+    upscaler_set_crt(upscaler, 160, 96);
+}
+
+void upscaler_set_palette(Upscaler *upscaler, UpscaleColor off, UpscaleColor on)
+{
+    upscaler->off = off;
+    upscaler->on = on;
+    update_phosphor_colors(upscaler);
+}
+
+void upscaler_set_crt(Upscaler *upscaler, u8 decay, u8 scanline)
+{
+    // decay is how much of a pixel is left one frame after it's turned
+    // off, scanline how bright the darkened rows are, both out of 256.
+    upscaler->decay = decay;
+    upscaler->scanline = scanline;
+    update_phosphor_colors(upscaler);
+}
+
+u32 upscaler_get_width(const Upscaler *upscaler)
+{
+    return GPU_SCREEN_WIDTH * upscaler->scale;
+}
+
+u32 upscaler_get_height(const Upscaler *upscaler)
+{
+    return GPU_SCREEN_HEIGHT * upscaler->scale;
+}
+
+void upscaler_render(Upscaler *upscaler, const Gpu *gpu, u8 *rgba, u32 pitch)
+{
+    switch (upscaler->filter)
+    {
+    case UPSCALE_NEAREST:
+        render_nearest(upscaler, gpu, rgba, pitch);
+        break;
+
+    case UPSCALE_EPX:
+        render_epx(upscaler, gpu, rgba, pitch);
+        break;
+
+    case UPSCALE_SCANLINES:
+        render_scanlines(upscaler, gpu, rgba, pitch);
+        break;
+    }
+}
+
+static void render_nearest(const Upscaler *upscaler, const Gpu *gpu, u8 *rgba, u32 pitch)
+{
+    const u8 scale = upscaler->scale;
+    const u32 palette[2] = {get_color(upscaler->off), get_color(upscaler->on)};
+    u32 colors[GPU_SCREEN_WIDTH];
+    u32 row[UPSCALE_ROW_SIZE];
+
+    // every source row is expanded once and then copied to the output
+    // rows it covers.
+    for (u8 y = 0; y < GPU_SCREEN_HEIGHT; y++)
+    {
+        for (u8 x = 0; x < GPU_SCREEN_WIDTH; x++)
+            colors[x] = palette[gpu_get_pixel(gpu, x, y) & 0x01];
+
+        fill_row(row, colors, GPU_SCREEN_WIDTH, scale, scale);
+        copy_row(row, upscaler_get_width(upscaler), rgba, pitch, y * scale, scale);
+    }
+}
+
+static void render_epx(const Upscaler *upscaler, const Gpu *gpu, u8 *rgba, u32 pitch)
+{
+    const u8 first_span = upscaler->scale / 2;
+    const u8 second_span = upscaler->scale - first_span;
+    const u32 palette[2] = {get_color(upscaler->off), get_color(upscaler->on)};
+    u64 rows[GPU_SCREEN_HEIGHT];
+    u32 top_colors[GPU_SCREEN_WIDTH * 2];
+    u32 bottom_colors[GPU_SCREEN_WIDTH * 2];
+    u32 row[UPSCALE_ROW_SIZE];
+
+    get_rows(gpu, rows);
+
+    for (u8 y = 0; y < GPU_SCREEN_HEIGHT; y++)
+    {
+        // the neighbours of a whole row at once, one bit per pixel; the
+        // edges use the pixel itself.
+        u64 p = rows[y];
+        u64 a = rows[y == 0 ? y : y - 1];
+        u64 d = rows[y == GPU_SCREEN_HEIGHT - 1 ? y : y + 1];
+        u64 c = (p >> 1) | (p & UPSCALE_FIRST_PIXEL);
+        u64 b = (p << 1) | (p & 0x01);
+
+        // the Scale2x rules, as masks of the pixels they apply to.
+        u64 top_left = ~(c ^ a) & (c ^ d) & (a ^ b);
+        u64 top_right = ~(a ^ b) & (a ^ c) & (b ^ d);
+        u64 bottom_left = ~(d ^ c) & (d ^ b) & (c ^ a);
+        u64 bottom_right = ~(b ^ d) & (b ^ a) & (d ^ c);
+
+        u64 e1 = (top_left & a) | (~top_left & p);
+        u64 e2 = (top_right & b) | (~top_right & p);
+        u64 e3 = (bottom_left & c) | (~bottom_left & p);
+        u64 e4 = (bottom_right & d) | (~bottom_right & p);
+
+        for (u8 x = 0; x < GPU_SCREEN_WIDTH; x++)
+        {
+            u8 shift = GPU_SCREEN_WIDTH - 1 - x;
+
+            top_colors[x * 2] = palette[(e1 >> shift) & 0x01];
+            top_colors[x * 2 + 1] = palette[(e2 >> shift) & 0x01];
+            bottom_colors[x * 2] = palette[(e3 >> shift) & 0x01];
+            bottom_colors[x * 2 + 1] = palette[(e4 >> shift) & 0x01];
+        }
+
+        u32 output_y = y * upscaler->scale;
+
+        fill_row(row, top_colors, GPU_SCREEN_WIDTH * 2, first_span, second_span);
+        copy_row(row, upscaler_get_width(upscaler), rgba, pitch, output_y, first_span);
+
+        fill_row(row, bottom_colors, GPU_SCREEN_WIDTH * 2, first_span, second_span);
+        copy_row(row, upscaler_get_width(upscaler), rgba, pitch, output_y + first_span, second_span);
+    }
+}
+
+static void render_scanlines(Upscaler *upscaler, const Gpu *gpu, u8 *rgba, u32 pitch)
+{
+    const u8 scale = upscaler->scale;
+    const u8 dark_rows = scale < 2 ? 0 : scale < 8 ? 1 : scale / 4;
+    u32 colors[GPU_SCREEN_WIDTH];
+    u32 dark_colors[GPU_SCREEN_WIDTH];
+    u32 row[UPSCALE_ROW_SIZE];
+
+    for (u8 y = 0; y < GPU_SCREEN_HEIGHT; y++)
+    {
+        u8 *phosphor = &upscaler->phosphor[y * GPU_SCREEN_WIDTH];
+
+        // lit pixels are at full brightness, the rest keep fading.
+        for (u8 x = 0; x < GPU_SCREEN_WIDTH; x++)
+        {
+            phosphor[x] = gpu_get_pixel(gpu, x, y) ? 255 : (phosphor[x] * upscaler->decay) >> 8;
+            colors[x] = upscaler->phosphor_colors[phosphor[x]];
+            dark_colors[x] = upscaler->scanline_colors[phosphor[x]];
+        }
+
+        u32 output_y = y * scale;
+
+        fill_row(row, colors, GPU_SCREEN_WIDTH, scale, scale);
+        copy_row(row, upscaler_get_width(upscaler), rgba, pitch, output_y, scale - dark_rows);
+
+        fill_row(row, dark_colors, GPU_SCREEN_WIDTH, scale, scale);
+        copy_row(row, upscaler_get_width(upscaler), rgba, pitch, output_y + scale - dark_rows, dark_rows);
+    }
+}
+
+static void fill_row(u32 *row, const u32 *colors, u16 count, u8 even_span, u8 odd_span)
+{
+    // spans are filled left to right, so the stores a span writes past
+    // its end are overwritten by the next one.
+    for (u16 i = 0; i < count; i += 2)
+    {
+        fill_span(row, colors[i], even_span);
+        row += even_span;
+        fill_span(row, colors[i + 1], odd_span);
+        row += odd_span;
+    }
+}
+
+static inline void fill_span(u32 *destination, u32 color, u8 span)
+{
+#if defined(__AVX2__)
+    __m256i value = _mm256_set1_epi32(color);
+
+    for (u8 i = 0; i < span; i += 8)
+        _mm256_storeu_si256((__m256i *)(destination + i), value);
+#elif defined(__SSE2__)
+    __m128i value = _mm_set1_epi32(color);
+
+    for (u8 i = 0; i < span; i += 4)
+        _mm_storeu_si128((__m128i *)(destination + i), value);
+#else
+    for (u8 i = 0; i < span; i++)
+        destination[i] = color;
+#endif
+}
+
+static void copy_row(const u32 *row, u32 width, u8 *rgba, u32 pitch, u32 y, u32 count)
+{
+    for (u32 i = 0; i < count; i++)
+        memcpy(rgba + (y + i) * pitch, row, width * sizeof(u32));
+}
+
+static void get_rows(const Gpu *gpu, u64 *rows)
+{
+    u8 frame[GPU_PACKED_FRAME_SIZE];
+
+    gpu_pack_frame(gpu, frame);
+
+    // the first pixel of each row ends up in the highest bit.
+    for (u8 y = 0; y < GPU_SCREEN_HEIGHT; y++)
+    {
+        rows[y] = 0;
+
+        for (u8 i = 0; i < GPU_SCREEN_WIDTH / 8; i++)
+            rows[y] = (rows[y] << 8) | frame[y * (GPU_SCREEN_WIDTH / 8) + i];
+    }
+}
+
+static void update_phosphor_colors(Upscaler *upscaler)
+{
+    UpscaleColor dark_off = upscaler->off;
+    UpscaleColor dark_on = upscaler->on;
+
+    dark_off.r = (dark_off.r * upscaler->scanline) >> 8;
+    dark_off.g = (dark_off.g * upscaler->scanline) >> 8;
+    dark_off.b = (dark_off.b * upscaler->scanline) >> 8;
+    dark_on.r = (dark_on.r * upscaler->scanline) >> 8;
+    dark_on.g = (dark_on.g * upscaler->scanline) >> 8;
+    dark_on.b = (dark_on.b * upscaler->scanline) >> 8;
+
+    // one color per phosphor level, so rendering never blends.
+    for (u16 i = 0; i < 256; i++)
+    {
+        upscaler->phosphor_colors[i] = blend_colors(upscaler->off, upscaler->on, i);
+        upscaler->scanline_colors[i] = blend_colors(dark_off, dark_on, i);
+    }
+}
+
+static inline u32 get_color(UpscaleColor color)
+{
+    u32 value;
+
+    // keeps the r, g, b, a byte order in memory on any host.
+    memcpy(&value, &color, sizeof(value));
+    return value;
+}
+
+static inline u32 blend_colors(UpscaleColor from, UpscaleColor to, u8 amount)
+{
+    UpscaleColor color = {
+        from.r + (((to.r - from.r) * amount) / 255),
+        from.g + (((to.g - from.g) * amount) / 255),
+        from.b + (((to.b - from.b) * amount) / 255),
+        from.a + (((to.a - from.a) * amount) / 255)};
+
+    return get_color(color);
+}
@@ -0,0 +1,68 @@
+#ifndef __UPSCALE_H__
+#define __UPSCALE_H__
+
+#include <string.h>
+#include "types.h"
+#include "gpu.h"
+
+#define UPSCALE_MAX_SCALE 16
+
+typedef enum UpscaleFilter
+{
+    UPSCALE_NEAREST,
+    UPSCALE_EPX,
+    UPSCALE_SCANLINES
+} UpscaleFilter;
+
+/**
+ * A color, stored in the output as r, g, b, a bytes.
+ */
+typedef struct UpscaleColor
+{
+    u8 r;
+    u8 g;
+    u8 b;
+    u8 a;
+} UpscaleColor;
+
+/**
+ * Defines a cpu upscaler.
+ * Expands the 64x32 gpu framebuffer to rgba at an integer scale, into a
+ * buffer owned by the caller, pitch bytes per row.
+ *
+ *  - UPSCALE_NEAREST: every pixel becomes a scale x scale block.
+ *  - UPSCALE_EPX: the Scale2x/EPX rules smooth diagonals at 2x, then the
+ *    result is scaled to the requested size (odd scales give the extra
+ *    row and column to the second half of each pixel).
+ *  - UPSCALE_SCANLINES: pixels fade out over a few frames, like a crt
+ *    phosphor, and the bottom rows of every pixel are darkened. The fade
+ *    keeps its state in the upscaler, so render every frame, in order.
+ *
+ * Rendering never allocates.
+ */
+typedef struct Upscaler
+{
+    UpscaleFilter filter;
+    u8 scale;
+    UpscaleColor off;
+    UpscaleColor on;
+    u8 decay;
+    u8 scanline;
+    u8 phosphor[GPU_SCREEN_WIDTH * GPU_SCREEN_HEIGHT];
+    u32 phosphor_colors[256];
+    u32 scanline_colors[256];
+} Upscaler;
+
+void upscaler_init(Upscaler *upscaler, UpscaleFilter filter, u8 scale);
+
+void upscaler_set_palette(Upscaler *upscaler, UpscaleColor off, UpscaleColor on);
+
+void upscaler_set_crt(Upscaler *upscaler, u8 decay, u8 scanline);
+
+u32 upscaler_get_width(const Upscaler *upscaler);
+
+u32 upscaler_get_height(const Upscaler *upscaler);
+
+void upscaler_render(Upscaler *upscaler, const Gpu *gpu, u8 *rgba, u32 pitch);
+
+#endif /*__UPSCALE_H__*/
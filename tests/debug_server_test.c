@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "debug_server.h"
+
+#define DELAY 5
+#define DONE 0x20A
+
+/**
+ * Sets the delay timer and spins on it until it runs out, then jumps to
+ * itself at DONE.
+ */
+static const u8 TIMER_WAIT_ROM[] = {
+    0x60, DELAY, // 200: LD V0, DELAY
+    0xF0, 0x15,  // 202: LD DT, V0
+    0xF0, 0x07,  // 204: LD V0, DT
+    0x30, 0x00,  // 206: SE V0, 0
+    0x12, 0x04,  // 208: JP 204
+    0x12, 0x0A   // 20A: JP 20A
+};
+
+static i32 connect_client(DebugServer *server, const char *path)
+{
+    struct sockaddr_un address;
+    i32 client = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path, strlen(path) + 1);
+
+    if (client < 0 || connect(client, (struct sockaddr *)&address, sizeof(address)) != 0)
+        return -1;
+
+    // the server only accepts it when it's polled.
+    debug_server_poll(server, 1000);
+    return client;
+}
+
+// the server answers on the same thread, so every request is followed by
+// a poll before the response is read.
+static bool step(DebugServer *server, i32 client, u32 count, u16 cycles_per_frame, u32 *executed)
+{
+    u8 payload[6] = {count & 0xFF, (count >> 8) & 0xFF, (count >> 16) & 0xFF, count >> 24,
+                     cycles_per_frame & 0xFF, cycles_per_frame >> 8};
+    u8 response[DEBUG_MAX_PAYLOAD];
+    u8 command;
+    u8 status;
+    u16 size;
+
+    if (!debug_send_message(client, DEBUG_STEP, DEBUG_OK, payload, cycles_per_frame > 0 ? 6 : 4) ||
+        debug_server_poll(server, 1000) != 1 ||
+        !debug_receive_message(client, &command, &status, response, &size) ||
+        command != DEBUG_STEP || status != DEBUG_OK || size < 5)
+        return false;
+
+    *executed = response[0] | (response[1] << 8) | (response[2] << 16) | ((u32)response[3] << 24);
+    return true;
+}
+
+static bool check(bool passed, const char *name)
+{
+    printf("%s %s\n", passed ? "ok  " : "FAIL", name);
+    return passed;
+}
+
+/**
+ * Steps a rom over a delay timer wait through the debug server: the
+ * timers have to tick every frame's worth of steps, as they do in a run,
+ * or the wait never ends.
+ */
+int main()
+{
+    static Cpu cpu;
+    char path[64];
+    u32 executed = 0;
+    bool passed = true;
+
+    snprintf(path, sizeof(path), "/tmp/chip8_test_%d.sock", (i32)getpid());
+
+    if (!cpu_init(&cpu) || !cpu_load_rom_from_memory(&cpu, TIMER_WAIT_ROM, sizeof(TIMER_WAIT_ROM)))
+        return 1;
+
+    DebugServer *server = debug_server_create(path, &cpu);
+    i32 client = server != NULL ? connect_client(server, path) : -1;
+
+    if (client < 0)
+    {
+        perror("Unable to start the debug server");
+        debug_server_free(server);
+        cpu_free(&cpu);
+        return 1;
+    }
+
+    // one frame of ten instructions per tick, the wait takes DELAY frames.
+    passed &= check(step(server, client, 1, 10, &executed) && executed == 1, "a single step");
+    passed &= check(cpu.delay_timer == 0, "the timer isn't set before LD DT");
+
+    for (u32 i = 0; i < DELAY * 10 + 10 && cpu.program_counter != DONE; i++)
+        passed &= step(server, client, 1, 10, &executed);
+
+    passed &= check(cpu.program_counter == DONE && cpu.delay_timer == 0, "single steps get past the timer wait");
+
+    // without a frame length, the one of the last step or run is used.
+    cpu_load_rom_from_memory(&cpu, TIMER_WAIT_ROM, sizeof(TIMER_WAIT_ROM));
+    passed &= check(step(server, client, DELAY * 10 + 10, 0, &executed) && executed == DELAY * 10 + 10,
+                    "a batch of steps runs every instruction");
+    passed &= check(cpu.program_counter == DONE, "a batch of steps gets past the timer wait");
+
+    close(client);
+    debug_server_free(server);
+    cpu_free(&cpu);
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,394 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "clock.h"
+#include "debug_server.h"
+
+#define LINE_SIZE 512
+
+/**
+ * The client side of a debug session: the registers and framebuffer as
+ * the server last reported them, kept up to date with its deltas.
+ */
+typedef struct Client
+{
+    i32 socket;
+    u32 executed;
+    u8 stop_reason;
+    u8 registers[DEBUG_REGISTERS_SIZE];
+    u8 framebuffer[GPU_PACKED_FRAME_SIZE];
+    u8 buffer[DEBUG_MAX_PAYLOAD];
+} Client;
+
+const char *stop_reasons[] = {"cycles", "draw", "sound", "key wait", "breakpoint", "fault", "timer wait"};
+const char *register_names[] = {"i", "pc", "sp", "dt", "st", "fault"};
+const u8 register_offsets[] = {DEBUG_REGISTER_I, DEBUG_REGISTER_PC, DEBUG_REGISTER_SP, DEBUG_REGISTER_DT, DEBUG_REGISTER_ST, DEBUG_REGISTER_FAULT};
+
+static bool connect_client(Client *client, const char *path)
+{
+    struct sockaddr_un address;
+
+    memset(client, 0, sizeof(Client));
+    memset(&address, 0, sizeof(address));
+
+    if (strlen(path) >= sizeof(address.sun_path))
+        return false;
+
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path, strlen(path) + 1);
+    client->socket = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    return client->socket >= 0 && connect(client->socket, (struct sockaddr *)&address, sizeof(address)) == 0;
+}
+
+static bool request(Client *client, u8 command, const u8 *payload, u16 size, u16 *response_size)
+{
+    u8 response_command;
+    u8 status;
+
+    if (!debug_send_message(client->socket, command, DEBUG_OK, payload, size) ||
+        !debug_receive_message(client->socket, &response_command, &status, client->buffer, response_size))
+    {
+        fprintf(stderr, "connection lost\n");
+        return false;
+    }
+
+    if (response_command != command || status != DEBUG_OK)
+    {
+        fprintf(stderr, "request failed (%d)\n", status);
+        return false;
+    }
+
+    return true;
+}
+
+static bool request_state(Client *client, u8 command, const u8 *payload, u16 size)
+{
+    u16 response_size;
+
+    if (!request(client, command, payload, size, &response_size) || response_size < 5)
+        return false;
+
+    client->executed = client->buffer[0] | (client->buffer[1] << 8) | (client->buffer[2] << 16) | ((u32)client->buffer[3] << 24);
+    client->stop_reason = client->buffer[4];
+
+    i32 registers = debug_decode_delta(client->registers, DEBUG_REGISTERS_SIZE, DEBUG_REGISTERS_BLOCK, client->buffer + 5, response_size - 5);
+
+    if (registers < 0)
+        return false;
+
+    return debug_decode_delta(client->framebuffer, GPU_PACKED_FRAME_SIZE, DEBUG_FRAMEBUFFER_BLOCK,
+                              client->buffer + 5 + registers, response_size - 5 - registers) >= 0;
+}
+
+static u16 get_register(const Client *client, u8 offset)
+{
+    if (offset == DEBUG_REGISTER_I || offset == DEBUG_REGISTER_PC)
+        return client->registers[offset] | (client->registers[offset + 1] << 8);
+
+    return client->registers[offset];
+}
+
+static void print_summary(const Client *client)
+{
+    printf("executed %u, stopped on %s, pc %03X\n", client->executed,
+           client->stop_reason < sizeof(stop_reasons) / sizeof(stop_reasons[0]) ? stop_reasons[client->stop_reason] : "?",
+           get_register(client, DEBUG_REGISTER_PC));
+}
+
+static void print_registers(const Client *client)
+{
+    for (u8 i = 0; i < 16; i++)
+        printf("V%X %02X%s", i, client->registers[DEBUG_REGISTER_V + i], i % 8 == 7 ? "\n" : "  ");
+
+    for (u8 i = 0; i < sizeof(register_offsets); i++)
+        printf("%s %X%s", register_names[i], get_register(client, register_offsets[i]), (u32)i + 1 < sizeof(register_offsets) ? "  " : "\n");
+
+    printf("stack");
+
+    for (u8 i = 0; i < CPU_STACK_SIZE; i++)
+        printf(" %03X", client->registers[DEBUG_REGISTER_STACK + i * 2] | (client->registers[DEBUG_REGISTER_STACK + i * 2 + 1] << 8));
+
+    printf("\n");
+}
+
+static void print_screen(const Client *client)
+{
+    for (u8 y = 0; y < GPU_SCREEN_HEIGHT; y++)
+    {
+        for (u8 x = 0; x < GPU_SCREEN_WIDTH; x++)
+        {
+            u16 i = y * GPU_SCREEN_WIDTH + x;
+            putchar(client->framebuffer[i / 8] & (0x80 >> (i % 8)) ? '#' : '.');
+        }
+
+        putchar('\n');
+    }
+}
+
+static bool read_memory(Client *client, u16 address, u16 length)
+{
+    u8 payload[4] = {address & 0xFF, address >> 8, length & 0xFF, length >> 8};
+    u16 size;
+
+    if (!request(client, DEBUG_READ_MEMORY, payload, sizeof(payload), &size))
+        return false;
+
+    for (u16 i = 0; i < size; i++)
+        printf("%s%02X", i % 16 == 0 ? (i > 0 ? "\n" : "") : " ", client->buffer[i]);
+
+    if (size > 0)
+        printf("\n");
+
+    return true;
+}
+
+static bool write_register(Client *client, const char *name, u16 value)
+{
+    u8 registers[DEBUG_REGISTERS_SIZE];
+    u8 previous[DEBUG_REGISTERS_SIZE];
+    u8 payload[4 + DEBUG_REGISTERS_SIZE];
+    i32 offset = -1;
+    u16 size;
+
+    memcpy(registers, client->registers, sizeof(registers));
+    memcpy(previous, client->registers, sizeof(previous));
+
+    if ((name[0] == 'v' || name[0] == 'V') && name[1] != '\0' && name[2] == '\0')
+        offset = DEBUG_REGISTER_V + (u8)strtoul(name + 1, NULL, 16);
+
+    for (u8 i = 0; i < sizeof(register_offsets); i++)
+    {
+        if (strcasecmp(name, register_names[i]) == 0)
+            offset = register_offsets[i];
+    }
+
+    if (offset < 0)
+    {
+        fprintf(stderr, "unknown register %s\n", name);
+        return false;
+    }
+
+    registers[offset] = value & 0xFF;
+
+    if (offset == DEBUG_REGISTER_I || offset == DEBUG_REGISTER_PC)
+        registers[offset + 1] = value >> 8;
+
+    // the delta is against what the server last reported, and the mirror is
+    // only updated by the state that comes back.
+    size = debug_encode_delta(previous, registers, DEBUG_REGISTERS_SIZE, DEBUG_REGISTERS_BLOCK, payload);
+
+    return request(client, DEBUG_WRITE_REGISTERS, payload, size, &size) &&
+           request_state(client, DEBUG_STATE, NULL, 0);
+}
+
+static bool write_framebuffer(Client *client, const char *file_name)
+{
+    u8 frame[GPU_PACKED_FRAME_SIZE];
+    u32 width = 0;
+    u32 height = 0;
+    u16 size;
+    FILE *file = fopen(file_name, "rb");
+
+    if (file == NULL)
+    {
+        perror(file_name);
+        return false;
+    }
+
+    // a binary pbm of the screen's size, already in the packed layout.
+    bool valid = fscanf(file, "P4 %u %u", &width, &height) == 2 && width == GPU_SCREEN_WIDTH &&
+                 height == GPU_SCREEN_HEIGHT && fgetc(file) != EOF && fread(frame, 1, sizeof(frame), file) == sizeof(frame);
+    fclose(file);
+
+    if (!valid)
+    {
+        fprintf(stderr, "%s is not a %ux%u binary pbm\n", file_name, GPU_SCREEN_WIDTH, GPU_SCREEN_HEIGHT);
+        return false;
+    }
+
+    if (!request(client, DEBUG_WRITE_FRAMEBUFFER, frame, sizeof(frame), &size))
+        return false;
+
+    // the server counts the written frame as reported, the mirror follows.
+    memcpy(client->framebuffer, frame, sizeof(frame));
+    return request_state(client, DEBUG_STATE, NULL, 0);
+}
+
+static bool benchmark(Client *client, u32 count)
+{
+    const u8 payload[4] = {1, 0, 0, 0};
+    f64 total = 0;
+    f64 worst = 0;
+
+    // a step and the state it leaves, one round trip each.
+    for (u32 i = 0; i < count; i++)
+    {
+        f64 start = clock_get_seconds();
+
+        if (!request_state(client, DEBUG_STEP, payload, sizeof(payload)))
+            return false;
+
+        f64 elapsed = clock_get_seconds() - start;
+        total += elapsed;
+        worst = elapsed > worst ? elapsed : worst;
+    }
+
+    printf("%u steps: %.1fus average, %.1fus worst\n", count, count > 0 ? total * 1e6 / count : 0, worst * 1e6);
+    return true;
+}
+
+static bool execute_command(Client *client, char *line)
+{
+    char *argv[DEBUG_MAX_PAYLOAD / 2];
+    u32 argc = 0;
+    u8 payload[DEBUG_MAX_PAYLOAD];
+    u16 size;
+
+    for (char *token = strtok(line, " \t\r\n"); token != NULL && argc < sizeof(argv) / sizeof(argv[0]); token = strtok(NULL, " \t\r\n"))
+        argv[argc++] = token;
+
+    if (argc == 0 || argv[0][0] == '#')
+        return true;
+
+    const char *command = argv[0];
+    u32 count = argc > 1 ? strtoul(argv[1], NULL, 10) : 1;
+    u16 address = argc > 1 ? strtoul(argv[1], NULL, 16) : 0;
+
+    if (strcmp(command, "step") == 0)
+    {
+        u8 step[4] = {count & 0xFF, (count >> 8) & 0xFF, (count >> 16) & 0xFF, count >> 24};
+
+        if (!request_state(client, DEBUG_STEP, step, sizeof(step)))
+            return false;
+
+        print_summary(client);
+    }
+    else if (strcmp(command, "run") == 0 && argc > 1)
+    {
+        u16 cycles_per_frame = argc > 2 ? strtoul(argv[2], NULL, 10) : 0;
+        u8 run[6] = {count & 0xFF, (count >> 8) & 0xFF, (count >> 16) & 0xFF, count >> 24, cycles_per_frame & 0xFF, cycles_per_frame >> 8};
+
+        if (!request_state(client, DEBUG_RUN, run, sizeof(run)))
+            return false;
+
+        print_summary(client);
+    }
+    else if (strcmp(command, "regs") == 0)
+    {
+        if (!request_state(client, DEBUG_STATE, NULL, 0))
+            return false;
+
+        print_registers(client);
+    }
+    else if (strcmp(command, "screen") == 0)
+    {
+        if (!request_state(client, DEBUG_STATE, NULL, 0))
+            return false;
+
+        print_screen(client);
+    }
+    else if (strcmp(command, "mem") == 0 && argc > 2)
+    {
+        return read_memory(client, address, strtoul(argv[2], NULL, 10));
+    }
+    else if (strcmp(command, "poke") == 0 && argc > 2)
+    {
+        payload[0] = address & 0xFF;
+        payload[1] = address >> 8;
+
+        for (u32 i = 2; i < argc; i++)
+            payload[i] = strtoul(argv[i], NULL, 16);
+
+        return request(client, DEBUG_WRITE_MEMORY, payload, argc, &size);
+    }
+    else if (strcmp(command, "set") == 0 && argc > 2)
+    {
+        if (!write_register(client, argv[1], strtoul(argv[2], NULL, 16)))
+            return false;
+
+        print_registers(client);
+    }
+    else if ((strcmp(command, "break") == 0 || strcmp(command, "clear") == 0) && argc > 1)
+    {
+        u8 breakpoint[3] = {address & 0xFF, address >> 8, command[0] == 'b'};
+
+        return request(client, DEBUG_BREAKPOINT, breakpoint, sizeof(breakpoint), &size);
+    }
+    else if (strcmp(command, "keys") == 0 && argc > 1)
+    {
+        u8 keys[2] = {address & 0xFF, address >> 8};
+
+        return request(client, DEBUG_KEYS, keys, sizeof(keys), &size);
+    }
+    else if (strcmp(command, "frame") == 0 && argc > 1)
+    {
+        if (!write_framebuffer(client, argv[1]))
+            return false;
+
+        print_screen(client);
+    }
+    else if (strcmp(command, "bench") == 0)
+    {
+        return benchmark(client, argc > 1 ? count : 10000);
+    }
+    else
+    {
+        fprintf(stderr, "unknown command: %s\n", command);
+    }
+
+    return true;
+}
+
+/**
+ * A debug client for debug_server, reading one command per line from the
+ * standard input, so sessions can be typed or scripted:
+ *
+ *     step [count]                   run instructions, ignoring breakpoints
+ *     run <cycles> [cycles per tick] run until a breakpoint, key wait or fault
+ *     regs                           print the registers
+ *     screen                         print the framebuffer
+ *     mem <address> <length>         print memory
+ *     poke <address> <byte>...       write memory
+ *     set <register> <value>         write v0-vf, i, pc, sp, dt, st or fault
+ *     break <address>                set a breakpoint
+ *     clear <address>                clear a breakpoint
+ *     keys <mask>                    set the pressed keys, one bit each
+ *     frame <file.pbm>               write the framebuffer from a 64x32 pbm
+ *     bench [count]                  time a step and read round trip
+ *
+ * Addresses, values and bytes are hex, counts are decimal.
+ */
+int main(int argc, char **argv)
+{
+    static Client client;
+    char line[LINE_SIZE];
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s <socket>\n", argv[0]);
+        return 1;
+    }
+
+    if (!connect_client(&client, argv[1]))
+    {
+        perror("Unable to connect to the debug server");
+        return 1;
+    }
+
+    // a failed command ends the session, so scripts stop where they broke.
+    while (fgets(line, sizeof(line), stdin) != NULL)
+    {
+        if (!execute_command(&client, line))
+        {
+            close(client.socket);
+            return 1;
+        }
+    }
+
+    close(client.socket);
+    return 0;
+}
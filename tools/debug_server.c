@@ -0,0 +1,78 @@
+#include <signal.h>
+#include <stdio.h>
+#include "debug_server.h"
+
+static volatile sig_atomic_t stopping = 0;
+
+static void stop(int signal)
+{
+    (void)signal;
+    stopping = 1;
+}
+
+static u32 read_rom(const char *file_name, u8 *rom, u32 size)
+{
+    FILE *file = fopen(file_name, "rb");
+
+    if (file == NULL)
+        return 0;
+
+    u32 read = fread(rom, 1, size, file);
+    fclose(file);
+    return read;
+}
+
+/**
+ * Runs a rom headless under a debug server, until interrupted:
+ *
+ *     debug_server roms/PONG /tmp/chip8.sock
+ *
+ * The cpu only moves when a client asks it to, see debug_client.
+ */
+int main(int argc, char **argv)
+{
+    static Cpu cpu;
+    static u8 rom[CPU_MEMORY_SIZE - CPU_PROGRAM_START];
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s <rom> <socket>\n", argv[0]);
+        return 1;
+    }
+
+    u32 size = read_rom(argv[1], rom, sizeof(rom));
+
+    if (size == 0)
+    {
+        fprintf(stderr, "Unable to read the rom %s\n", argv[1]);
+        return 1;
+    }
+
+    // loaded from memory, cpu_load_rom would write the disassembly to the
+    // working directory.
+    if (!cpu_init(&cpu) || !cpu_load_rom_from_memory(&cpu, rom, size))
+    {
+        fprintf(stderr, "Unable to allocate the cpu\n");
+        return 1;
+    }
+
+    DebugServer *server = debug_server_create(argv[2], &cpu);
+
+    if (server == NULL)
+    {
+        perror("Unable to create the debug server");
+        cpu_free(&cpu);
+        return 1;
+    }
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    // a signal interrupts the wait, so the socket is always removed.
+    while (!stopping)
+        debug_server_poll(server, -1);
+
+    debug_server_free(server);
+    cpu_free(&cpu);
+    return 0;
+}
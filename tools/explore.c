@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <time.h>
+#include "clock.h"
+#include "explorer.h"
+
+#define CYCLES_PER_FRAME 10
+#define REPORT_INTERVAL 1.0
+#define FILE_NAME_SIZE 512
+
+static u32 read_rom(const char *file_name, u8 *rom, u32 size)
+{
+    FILE *file = fopen(file_name, "rb");
+
+    if (file == NULL)
+        return 0;
+
+    u32 read = fread(rom, 1, size, file);
+    fclose(file);
+    return read;
+}
+
+static i32 replay(const u8 *rom, u32 size, const char *file_name)
+{
+    static Cpu cpu;
+    u16 cycles_per_frame;
+    u32 count;
+    u16 *inputs = explorer_load_inputs(file_name, &count, &cycles_per_frame);
+
+    if (inputs == NULL)
+    {
+        fprintf(stderr, "Unable to read the inputs %s\n", file_name);
+        return 1;
+    }
+
+    if (!cpu_init(&cpu) || !cpu_load_rom_from_memory(&cpu, rom, size))
+    {
+        fprintf(stderr, "Unable to load the rom\n");
+        free(inputs);
+        cpu_free(&cpu);
+        return 1;
+    }
+
+    ExplorerFinding finding = explorer_replay(&cpu, inputs, count, cycles_per_frame);
+
+    printf("%u steps: %s, pc %03X, sp %u\n", count, explorer_get_finding_name(finding), cpu.program_counter, cpu.stack_pointer);
+
+    free(inputs);
+    cpu_free(&cpu);
+    return finding != EXPLORER_NONE ? 0 : 1;
+}
+
+/**
+ * Explores a rom with random inputs for a number of seconds, guided by
+ * coverage, and saves the inputs that reproduce every finding to a
+ * directory, named after the finding and its address:
+ *
+ *     explore roms/TETRIS 60 findings
+ *     explore roms/TETRIS --replay findings/underflow_20C.keys
+ *
+ * Coverage, states and runs are reported every second.
+ */
+int main(int argc, char **argv)
+{
+    static u8 rom[CPU_MEMORY_SIZE];
+    char file_name[FILE_NAME_SIZE];
+
+    if (argc != 4)
+    {
+        fprintf(stderr, "usage: %s <rom> <seconds> <directory>\n       %s <rom> --replay <inputs>\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    u32 size = read_rom(argv[1], rom, sizeof(rom));
+
+    if (size == 0)
+    {
+        fprintf(stderr, "Unable to read the rom %s\n", argv[1]);
+        return 1;
+    }
+
+    if (strcmp(argv[2], "--replay") == 0)
+        return replay(rom, size, argv[3]);
+
+    Explorer *explorer = explorer_create(rom, size, CYCLES_PER_FRAME, (u32)time(NULL));
+
+    if (explorer == NULL)
+        return 1;
+
+    const f64 duration = atof(argv[2]);
+    const f64 start = clock_get_seconds();
+    f64 report = start + REPORT_INTERVAL;
+    ExplorerStats last = explorer->stats;
+
+    while (clock_get_seconds() - start < duration)
+    {
+        // the clock is only read every few runs, a run is a few microseconds.
+        for (u32 i = 0; i < 64; i++)
+        {
+            ExplorerFinding finding = explorer_run(explorer);
+            u32 count;
+
+            if (finding == EXPLORER_NONE)
+                continue;
+
+            const u16 *inputs = explorer_get_inputs(explorer, &count);
+            snprintf(file_name, sizeof(file_name), "%s/%s_%03X.keys", argv[3], explorer_get_finding_name(finding),
+                     explorer->finding_address);
+
+            if (!explorer_save_inputs(file_name, inputs, count, CYCLES_PER_FRAME))
+                perror(file_name);
+
+            printf("%s at %03X after %u steps: %s\n", explorer_get_finding_name(finding), explorer->finding_address, count, file_name);
+        }
+
+        f64 now = clock_get_seconds();
+
+        if (now < report)
+            continue;
+
+        const ExplorerStats *stats = &explorer->stats;
+        f64 elapsed = now - report + REPORT_INTERVAL;
+
+        printf("%5.0fs covered %u of %u reachable (+%u), %llu states (%.0f/s), %.0f runs/s, %.1fM instructions/s, %u entries, %u findings\n",
+               now - start, stats->covered, stats->reachable, stats->covered - last.covered,
+               (unsigned long long)stats->states, (stats->states - last.states) / elapsed,
+               (stats->runs - last.runs) / elapsed, (stats->instructions - last.instructions) / elapsed / 1e6,
+               stats->entries, stats->findings);
+
+        last = *stats;
+        report = now + REPORT_INTERVAL;
+    }
+
+    explorer_free(explorer);
+    return 0;
+}
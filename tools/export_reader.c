@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <time.h>
+#include "clock.h"
+#include "exporter.h"
+
+#define POLL_INTERVAL 250000
+
+static void print_frame(const u8 *framebuffer, u16 program_counter, u8 delay_timer, u32 lit_pixels)
+{
+    for (u8 y = 0; y < GPU_SCREEN_HEIGHT; y++)
+    {
+        for (u8 x = 0; x < GPU_SCREEN_WIDTH; x++)
+            putchar(framebuffer[y * GPU_SCREEN_WIDTH + x] ? '#' : '.');
+
+        putchar('\n');
+    }
+
+    printf("pc %03X dt %u, %u pixels lit\n", program_counter, delay_timer, lit_pixels);
+}
+
+/**
+ * A reference reader for the frames exported by the emulator (F12), reading
+ * them in place from the shared segment until it has seen a number of them:
+ *
+ *     export_reader /chip8 600 0020
+ *
+ * The optional hex mask is held on the keypad while it runs. The frames
+ * seen, missed and torn, and the time a read takes, are printed along with
+ * the last frame.
+ */
+int main(int argc, char **argv)
+{
+    static u8 framebuffer[GPU_SCREEN_WIDTH * GPU_SCREEN_HEIGHT];
+    const struct timespec interval = {0, POLL_INTERVAL};
+    u64 last_frame = 0;
+    u64 seen = 0;
+    u64 missed = 0;
+    u64 torn = 0;
+    u16 program_counter = 0;
+    u8 delay_timer = 0;
+    u32 lit_pixels = 0;
+    f64 read_time = 0;
+
+    if (argc != 3 && argc != 4)
+    {
+        fprintf(stderr, "usage: %s <name> <frames> [keys]\n", argv[0]);
+        return 1;
+    }
+
+    Exporter *exporter = exporter_open(argv[1]);
+    u64 frames = strtoull(argv[2], NULL, 10);
+
+    if (exporter == NULL)
+    {
+        fprintf(stderr, "Unable to open the exported segment %s\n", argv[1]);
+        return 1;
+    }
+
+    if (argc == 4)
+        exporter_send_keys(exporter, strtoul(argv[3], NULL, 16));
+
+    while (seen < frames)
+    {
+        u32 sequence;
+        f64 start = clock_get_seconds();
+        const ExportSlot *slot = exporter_begin_read(exporter, &sequence);
+        u64 frame = slot->frame;
+        u32 lit = 0;
+
+        // nothing new yet: polling is only a load, the emulator publishes
+        // at 60hz so there's no point spinning on it.
+        if (frame == last_frame)
+        {
+            nanosleep(&interval, NULL);
+            continue;
+        }
+
+        // the pixels are read where the emulator wrote them, a consumer
+        // would run its own analysis here instead.
+        for (u32 i = 0; i < sizeof(slot->framebuffer); i++)
+            lit += slot->framebuffer[i];
+
+        program_counter = slot->program_counter;
+        delay_timer = slot->delay_timer;
+
+        if (seen + 1 == frames)
+            memcpy(framebuffer, slot->framebuffer, sizeof(framebuffer));
+
+        if (!exporter_end_read(slot, sequence))
+        {
+            torn++;
+            continue;
+        }
+
+        read_time += clock_get_seconds() - start;
+        missed += last_frame > 0 && frame > last_frame + 1 ? frame - last_frame - 1 : 0;
+        last_frame = frame;
+        lit_pixels = lit;
+        seen++;
+    }
+
+    if (argc == 4)
+        exporter_send_keys(exporter, 0);
+
+    print_frame(framebuffer, program_counter, delay_timer, lit_pixels);
+    printf("%llu frames up to %llu, %llu missed, %llu torn, %.2fus per read\n",
+           (unsigned long long)seen, (unsigned long long)last_frame, (unsigned long long)missed,
+           (unsigned long long)torn, seen > 0 ? read_time * 1e6 / seen : 0);
+
+    exporter_free(exporter);
+    return 0;
+}
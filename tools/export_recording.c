@@ -0,0 +1,27 @@
+#include <stdio.h>
+#include "recorder.h"
+
+/**
+ * Exports a gameplay recording (see recorder.h) as a sequence of binary
+ * pbm images, one per emulated frame:
+ *
+ *     export_recording recording.c8r frames/frame_
+ *
+ * writes frames/frame_000000.pbm, frames/frame_000001.pbm and so on.
+ */
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s <recording> <output prefix>\n", argv[0]);
+        return 1;
+    }
+
+    i64 frames = recorder_export_pbm(argv[1], argv[2]);
+
+    if (frames < 0)
+        return 1;
+
+    printf("%lld frames\n", (long long)frames);
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include "clock.h"
+#include "latency.h"
+
+#define FRAME_RATE 60
+
+static u32 read_rom(const char *file_name, u8 *rom, u32 size)
+{
+    FILE *file = fopen(file_name, "rb");
+
+    if (file == NULL)
+        return 0;
+
+    u32 read = fread(rom, 1, size, file);
+    fclose(file);
+    return read;
+}
+
+/**
+ * Measures input to pixel latency headless: a key is pressed and released
+ * at random intervals around the given one, in frames, and every draw is
+ * checked, so the emulated latency is precise to the instruction:
+ *
+ *     latency_bench roms/BRIX 6000 10 4 20
+ *
+ * There's nothing to present, so a frame is presented as soon as it's
+ * emulated. The histograms are printed per stage.
+ */
+int main(int argc, char **argv)
+{
+    static Cpu cpu;
+    static Latency latency;
+    static u8 rom[CPU_MEMORY_SIZE - CPU_PROGRAM_START];
+
+    if (argc != 5 && argc != 6)
+    {
+        fprintf(stderr, "usage: %s <rom> <frames> <cycles> <key> [interval]\n", argv[0]);
+        return 1;
+    }
+
+    u32 frames = atoi(argv[2]);
+    u32 cycles = atoi(argv[3]);
+    u8 key = strtoul(argv[4], NULL, 16) & 0x0F;
+    u32 interval = argc == 6 ? atoi(argv[5]) : 20;
+    u32 next_transition = interval;
+    u32 size = read_rom(argv[1], rom, sizeof(rom));
+
+    if (size == 0)
+    {
+        fprintf(stderr, "Unable to read the rom %s\n", argv[1]);
+        return 1;
+    }
+
+    // loaded from memory, cpu_load_rom would write the disassembly to the
+    // working directory.
+    if (!cpu_init(&cpu) || !cpu_load_rom_from_memory(&cpu, rom, size))
+    {
+        fprintf(stderr, "Unable to allocate the cpu\n");
+        return 1;
+    }
+    latency_init(&latency);
+    srand(1);
+
+    for (u32 frame = 0; frame < frames; frame++)
+    {
+        CpuStopReason reason = CPU_STOP_CYCLES;
+        u32 executed = 0;
+
+        // transitions are spread over the frames so they don't always hit
+        // the rom at the same point of its loop.
+        if (frame == next_transition)
+        {
+            keyboard_set_key_pressed(&cpu.keyboard, key, !keyboard_is_key_pressed(&cpu.keyboard, key));
+            latency_key_event(&latency, &cpu, clock_get_seconds(), (f64)frame / FRAME_RATE);
+            next_transition += interval / 2 + rand() % (interval + 1);
+        }
+
+        latency_begin_frame(&latency, clock_get_seconds());
+
+        while (executed < cycles)
+        {
+            executed += cpu_run(&cpu, cycles - executed, &reason);
+
+            if (reason == CPU_STOP_DRAW)
+                latency_check_draw(&latency, &cpu, clock_get_seconds(), (frame + (f64)executed / cycles) / FRAME_RATE);
+
+            // the rest of the frame would only spin on the wait.
+            if (reason == CPU_STOP_KEY_WAIT || reason == CPU_STOP_TIMER_WAIT || reason == CPU_STOP_FAULT)
+                break;
+        }
+
+        cpu_tick_timers(&cpu);
+        latency_present(&latency, clock_get_seconds());
+    }
+
+    latency_print(&latency, stdout);
+    cpu_free(&cpu);
+    return 0;
+}
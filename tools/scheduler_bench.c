@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <string.h>
+#include "clock.h"
+#include "scheduler.h"
+
+#define CYCLES_PER_FRAME 10
+#define KEY_PRESS_RATE 120
+
+static bool load_images(MemoryImage **images, u32 count, char **file_names)
+{
+    static u8 rom[CPU_MEMORY_SIZE];
+
+    for (u32 i = 0; i < count; i++)
+    {
+        FILE *file = fopen(file_names[i], "rb");
+
+        if (file == NULL)
+        {
+            perror(file_names[i]);
+            return false;
+        }
+
+        u32 size = fread(rom, 1, sizeof(rom), file);
+        fclose(file);
+
+        images[i] = cpu_create_image(rom, size);
+
+        if (images[i] == NULL)
+        {
+            fprintf(stderr, "Unable to allocate the image of %s\n", file_names[i]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void load_instances(Cpu *cpus, u32 count, MemoryImage **images, u32 image_count)
+{
+    for (u32 i = 0; i < count; i++)
+        cpu_load_image(&cpus[i], images[i % image_count]);
+}
+
+// a key is pressed on roughly one instance in KEY_PRESS_RATE every frame,
+// and released on the next; the same seed gives both runs the same input.
+static u16 next_keys(u16 keys)
+{
+    if (keys != 0)
+        return 0;
+
+    return rand() % KEY_PRESS_RATE == 0 ? 1 << (rand() % 16) : 0;
+}
+
+/**
+ * Runs a pool of instances sharing the given roms, once with every
+ * instance running its full budget every frame and once under the
+ * scheduler, and compares the cost per frame:
+ *
+ *     scheduler_bench 10000 600 4 roms/PONG roms/MISSILE roms/BLINKY
+ *
+ * Keys are pressed at random, and the scheduler's counts are printed
+ * for the last frame.
+ */
+int main(int argc, char **argv)
+{
+    if (argc < 5)
+    {
+        fprintf(stderr, "usage: %s <instances> <frames> <threads> <rom>...\n", argv[0]);
+        return 1;
+    }
+
+    u32 count = atoi(argv[1]);
+    u32 frames = atoi(argv[2]);
+    u32 threads = atoi(argv[3]);
+    u32 image_count = argc - 4;
+    MemoryImage **images = calloc(image_count, sizeof(MemoryImage *));
+    Cpu *cpus = memory_allocate_aligned(count * sizeof(Cpu));
+    u16 *keys = calloc(count, sizeof(u16));
+
+    if (images == NULL || cpus == NULL || keys == NULL || !load_images(images, image_count, argv + 4))
+        return 1;
+
+    for (u32 i = 0; i < count; i++)
+    {
+        if (!cpu_init(&cpus[i]))
+        {
+            fprintf(stderr, "Unable to allocate the framebuffers\n");
+            return 1;
+        }
+    }
+
+    load_instances(cpus, count, images, image_count);
+    srand(1);
+
+    u64 baseline_instructions = 0;
+    f64 start = clock_get_seconds();
+
+    for (u32 frame = 0; frame < frames; frame++)
+    {
+        for (u32 i = 0; i < count; i++)
+        {
+            keys[i] = next_keys(keys[i]);
+            cpus[i].keyboard.memory = keys[i];
+            baseline_instructions += cpu_run(&cpus[i], CYCLES_PER_FRAME, NULL);
+            cpu_tick_timers(&cpus[i]);
+        }
+    }
+
+    f64 baseline = clock_get_seconds() - start;
+
+    load_instances(cpus, count, images, image_count);
+    memset(keys, 0, count * sizeof(u16));
+    srand(1);
+
+    Scheduler *scheduler = scheduler_create(CYCLES_PER_FRAME, threads);
+    SchedulerStats stats;
+    u64 instructions = 0;
+
+    for (u32 i = 0; i < count; i++)
+        scheduler_add(scheduler, &cpus[i]);
+
+    start = clock_get_seconds();
+
+    for (u32 frame = 0; frame < frames; frame++)
+    {
+        for (u32 i = 0; i < count; i++)
+        {
+            u16 next = next_keys(keys[i]);
+
+            if (next != keys[i])
+                scheduler_set_keys(scheduler, i, next);
+
+            keys[i] = next;
+        }
+
+        scheduler_run_frame(scheduler);
+        scheduler_get_stats(scheduler, &stats);
+        instructions += stats.instructions;
+    }
+
+    f64 scheduled = clock_get_seconds() - start;
+
+    printf("%u instances, %u roms, %u frames\n", count, image_count, frames);
+    printf("full budget: %.1fus per frame, %.1f instructions per instance\n",
+           frames > 0 ? baseline * 1e6 / frames : 0, frames > 0 ? (f64)baseline_instructions / frames / count : 0);
+    printf("scheduled (%u threads): %.1fus per frame, %.1f instructions per instance\n", threads,
+           frames > 0 ? scheduled * 1e6 / frames : 0, frames > 0 ? (f64)instructions / frames / count : 0);
+    printf("runnable %u, key wait %u, timer wait %u, halted %u\n",
+           stats.runnable, stats.key_waiting, stats.timer_waiting, stats.halted);
+
+    scheduler_free(scheduler);
+
+    for (u32 i = 0; i < count; i++)
+        cpu_free(&cpus[i]);
+
+    for (u32 i = 0; i < image_count; i++)
+        memory_image_release(images[i]);
+
+    free(images);
+    memory_free_aligned(cpus);
+    free(keys);
+    return 0;
+}
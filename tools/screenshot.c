@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <string.h>
+#include "clock.h"
+#include "cpu.h"
+#include "upscale.h"
+
+#define CYCLES_PER_FRAME 10
+
+static u32 read_rom(const char *file_name, u8 *rom, u32 size)
+{
+    FILE *file = fopen(file_name, "rb");
+
+    if (file == NULL)
+        return 0;
+
+    u32 read = fread(rom, 1, size, file);
+    fclose(file);
+    return read;
+}
+
+/**
+ * Runs a rom headless for a number of frames and saves the last one,
+ * upscaled on the cpu, as a binary ppm:
+ *
+ *     screenshot roms/PONG 600 10 scanlines pong.ppm
+ *
+ * Every frame is upscaled, as a stream would be, and the average cost
+ * per frame is printed.
+ */
+int main(int argc, char **argv)
+{
+    static u8 rgba[GPU_SCREEN_WIDTH * UPSCALE_MAX_SCALE * GPU_SCREEN_HEIGHT * UPSCALE_MAX_SCALE * 4];
+    static Cpu cpu;
+    static u8 rom[CPU_MEMORY_SIZE - CPU_PROGRAM_START];
+    Upscaler upscaler;
+    UpscaleFilter filter = UPSCALE_NEAREST;
+    f64 elapsed = 0;
+
+    if (argc != 6)
+    {
+        fprintf(stderr, "usage: %s <rom> <frames> <scale> <nearest|epx|scanlines> <output.ppm>\n", argv[0]);
+        return 1;
+    }
+
+    if (strcmp(argv[4], "epx") == 0)
+        filter = UPSCALE_EPX;
+    else if (strcmp(argv[4], "scanlines") == 0)
+        filter = UPSCALE_SCANLINES;
+
+    u32 frames = atoi(argv[2]);
+    upscaler_init(&upscaler, filter, atoi(argv[3]));
+
+    const u32 width = upscaler_get_width(&upscaler);
+    const u32 height = upscaler_get_height(&upscaler);
+    u32 size = read_rom(argv[1], rom, sizeof(rom));
+
+    if (size == 0)
+    {
+        fprintf(stderr, "Unable to read the rom %s\n", argv[1]);
+        return 1;
+    }
+
+    // loaded from memory, cpu_load_rom would write the disassembly to the
+    // working directory.
+    if (!cpu_init(&cpu) || !cpu_load_rom_from_memory(&cpu, rom, size))
+    {
+        fprintf(stderr, "Unable to allocate the cpu\n");
+        return 1;
+    }
+
+    for (u32 i = 0; i < frames; i++)
+    {
+        cpu_run(&cpu, CYCLES_PER_FRAME, NULL);
+        cpu_tick_timers(&cpu);
+
+        f64 start = clock_get_seconds();
+        upscaler_render(&upscaler, cpu_get_gpu(&cpu), rgba, width * 4);
+        elapsed += clock_get_seconds() - start;
+    }
+
+    printf("%ux%u %s: %.1fus per frame\n", width, height, argv[4], frames > 0 ? elapsed * 1e6 / frames : 0);
+    cpu_free(&cpu);
+
+    FILE *file = fopen(argv[5], "wb");
+
+    if (file == NULL)
+    {
+        perror("Unable to write the screenshot");
+        return 1;
+    }
+
+    fprintf(file, "P6\n%u %u\n255\n", width, height);
+
+    for (u32 i = 0; i < width * height; i++)
+        fwrite(&rgba[i * 4], 1, 3, file);
+
+    fclose(file);
+    return 0;
+}